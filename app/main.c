@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "../src/lab.h"
+#include "../src/input.h"
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <stdbool.h>
@@ -7,116 +8,162 @@
 #include <sys/types.h>
 #include <termios.h>
 #include <errno.h>
-
-void create_process(char **argv, struct shell *sh, bool background);
-bool check_background(char *line);
-
-int main(int argc, char **argv)
+#include <poll.h>
+#include <fcntl.h>
+
+/*
+ * Read a character for readline while also watching for finished jobs, so
+ * completions are reported as they happen instead of after the next Enter.
+ */
+static int job_aware_getc(FILE *in)
 {
+  struct pollfd fds[2] = {
+      {.fd = fileno(in), .events = POLLIN},
+      {.fd = jobs_event_fd(), .events = POLLIN},
+  };
 
-  parse_args(argc, argv);
-
-  if (argc > 1 && strcmp(argv[1], "-v") == 0)
+  for (;;)
   {
-    return 0;
+    if (poll(fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return rl_getc(in);
+    }
+    if ((fds[1].revents & POLLIN) && jobs_reap() > 0)
+    {
+      rl_clear_visible_line();
+      check_jobs();
+      rl_forced_update_display();
+    }
+    if (fds[0].revents)
+    {
+      return rl_getc(in);
+    }
   }
+}
 
-  struct shell terminal = {0};
-  sh_init(&terminal);
-  char *line;
-
-  using_history();
+/*
+ * The next command, which may span lines where a quote or a backslash
+ * continues it: readline for a terminal, the block reader for anything
+ * else. Only readline's lines have to be freed by the caller.
+ */
+static char *next_line(struct shell *sh, struct line_reader *in)
+{
+  if (!sh->shell_is_interactive)
+  {
+    return reader_command(in, NULL);
+  }
 
-  while ((line = readline(terminal.prompt)))
+  // Like sh, an open quote or a trailing backslash asks for more with "> "
+  char *line = readline(sh->prompt);
+  while (line != NULL && parse_incomplete(line))
   {
-    line = trim_white(line);
-    if (strlen(line) == 0)
+    char *more = readline("> ");
+    if (more == NULL)
     {
-      printf("line == %s\n", line);
-      free(line);
-      continue;
+      break;
     }
-    check_jobs();
-    add_history(line);
-    bool background = check_background(line);
-    char **argv = cmd_parse(line);
-    bool executed_builtin = do_builtin(&terminal, argv);
-    if (executed_builtin)
+    size_t len = strlen(line);
+    char *joined = realloc(line, len + strlen(more) + 2);
+    if (joined == NULL)
     {
-      cmd_free(argv);
-      free(line);
-    }
-    else
-    {
-      create_process(argv, &terminal, background);
-      cmd_free(argv);
-      free(line);
+      free(more);
+      break;
     }
+    joined[len] = '\n';
+    strcpy(joined + len + 1, more);
+    free(more);
+    line = joined;
   }
+  return line;
+}
 
-  cleanup_jobs();
+int main(int argc, char **argv)
+{
+  struct shell terminal = {0};
 
-  sh_destroy(&terminal);
+  parse_args(&terminal, argc, argv);
 
-  return 0;
-}
+  if (argc > 1 && strcmp(argv[1], "-v") == 0)
+  {
+    return 0;
+  }
 
-void create_process(char **argv, struct shell *sh, bool background)
-{
-  pid_t pid;
+  sh_init(&terminal);
+  char *line;
 
-  pid = fork();
+  if (terminal.command != NULL)
+  {
+    sh_run_string(&terminal, terminal.command);
+    jobs_wait_pending();
+    cleanup_jobs();
+    sh_destroy(&terminal);
+    return terminal.last_status;
+  }
 
-  if (pid == 0)
+  int fd = STDIN_FILENO;
+  if (terminal.script != NULL && (fd = open(terminal.script, O_RDONLY | O_CLOEXEC)) < 0)
   {
-    if (!background)
-    {
-      pid_t child = getpid();
-      setpgid(child, child);
-      tcsetpgrp(sh->shell_terminal, child);
-
-      signal(SIGINT, SIG_DFL);
-      signal(SIGQUIT, SIG_DFL);
-      signal(SIGTSTP, SIG_DFL);
-      signal(SIGTTIN, SIG_DFL);
-      signal(SIGTTOU, SIG_DFL);
-    }
+    fprintf(stderr, "%s: %s: %s\n", argv[0], terminal.script, strerror(errno));
+    sh_destroy(&terminal);
+    return 127;
+  }
+  struct line_reader input;
+  reader_init(&input, fd);
 
-    if(execvp(argv[0], argv) == -1) {
-      perror("execvp failed");
-    }
-    exit(EXIT_FAILURE);
+  if (terminal.shell_is_interactive)
+  {
+    using_history();
+    rl_getc_function = job_aware_getc;
   }
-  else if (pid > 0)
+
+  while ((line = next_line(&terminal, &input)))
   {
-    setpgid(pid, pid);
-    if (background)
+    // Everything from here to the next prompt counts for the stats built in
+    uint64_t start = stats_now();
+    char *cmd = trim_white(line);
+    stats_record(&terminal.stats, STAT_TRIM, start, NULL);
+    if (strlen(cmd) == 0)
+    {
+      if (terminal.shell_is_interactive)
+      {
+        printf("line == %s\n", cmd);
+        free(line);
+      }
+      continue;
+    }
+    if (terminal.shell_is_interactive)
     {
-      add_job(pid, argv);
+      add_history(cmd);
     }
-    else
+
+    sh_run_line(&terminal, cmd, false);
+    stats_record(&terminal.stats, STAT_LINE, start, cmd);
+
+    if (terminal.shell_is_interactive)
     {
-      int status;
-      tcsetpgrp(STDIN_FILENO, pid);
-      waitpid(pid, &status, WUNTRACED);
-      tcsetpgrp(STDIN_FILENO, getpgrp());
+      free(line);
     }
   }
-  else
+
+  reader_destroy(&input);
+  if (fd != STDIN_FILENO)
   {
-    perror("fork failed");
+    close(fd);
   }
-}
 
-bool check_background(char *line)
-{
-  size_t len = strlen(line);
-  while (len > 0 && isspace(line[len - 1]))
-    len--;
-  if (len > 0 && line[len - 1] == '&')
+  // A script's queued jobs still run; an interactive shell just drops them
+  if (!terminal.shell_is_interactive)
   {
-    line[len - 1] = '\0';
-    return true;
+    jobs_wait_pending();
   }
-  return false;
+  cleanup_jobs();
+
+  sh_destroy(&terminal);
+
+  // Like sh, a script or a pipe exits with the status of its last command
+  return terminal.shell_is_interactive ? 0 : terminal.last_status;
 }
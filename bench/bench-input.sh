@@ -0,0 +1,41 @@
+#!/bin/sh
+# Throughput of a command file piped into the shell, i.e.
+# `cat cmds.txt | myprogram`. Only built ins are used so the time goes to
+# reading and parsing input rather than to starting processes.
+#
+# usage: bench/bench-input.sh [-n lines] [-r runs] [shell...]
+# Build the shells without sanitizers (BENCH_CFLAGS) for meaningful numbers.
+
+lines=100000
+runs=5
+while getopts n:r: opt; do
+    case $opt in
+    n) lines=$OPTARG ;;
+    r) runs=$OPTARG ;;
+    *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 0 ] && set -- ./myprogram
+
+cmds=$(mktemp)
+trap 'rm -f "$cmds"' EXIT
+awk -v n="$lines" 'BEGIN {
+    split("cd .|pwd|  cd /tmp  |hash -r|jobs|cd / && pwd", c, "|")
+    for (i = 0; i < n; i++) print c[i % 6 + 1]
+}' >"$cmds"
+
+now() { date +%s%N; }
+
+for sh in "$@"; do
+    best=
+    for r in $(seq "$runs"); do
+        start=$(now)
+        cat "$cmds" | "$sh" >/dev/null 2>&1
+        ns=$(($(now) - start))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then best=$ns; fi
+    done
+    awk -v sh="$sh" -v n="$lines" -v ns="$best" 'BEGIN {
+        printf "%-24s %8d lines %8.1f ms %10.0f lines/s\n", sh, n, ns / 1e6, n / (ns / 1e9)
+    }'
+done
@@ -0,0 +1,259 @@
+/**
+ * Microbenchmarks for the shell's internals: cmd_parse, trim_white,
+ * get_prompt, do_builtin dispatch, and the job table (add_job, check_jobs,
+ * show_jobs) holding 10, 1k and 100k jobs. Build and run with `make bench`
+ * (no sanitizers). The output is one JSON document whose results array
+ * has an object per case, each on a line of its own, with the median and
+ * the fastest ns per operation over the repetitions, so two versions can
+ * be compared with any JSON tool.
+ *
+ * The job table is filled with pids above the kernel's pid_max, which can
+ * never belong to a real process, so 100k jobs cost no processes. That
+ * needs the SIGCHLD path (a pidfd can only be opened for a live pid), so
+ * MY_JOB_EVENTS=sigchld is set before the first job. Reaping is measured
+ * with one real child per iteration on top of the fake jobs.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/lab.h"
+
+#define REPS 5
+#define FAKE_PID (1 << 23) // pid_max is at most 2^22
+
+static FILE *out;
+static int first = 1;
+static volatile size_t sink; // every result is stored here, so none is optimized away
+
+static int by_value(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// One entry of the results array, from the ns per operation of each repetition
+static void report(const char *name, const char *arg, int jobs, long iters, double *ns, int reps)
+{
+    qsort(ns, (size_t)reps, sizeof(ns[0]), by_value);
+    fprintf(out, "%s\n  {\"name\":\"%s\",\"case\":\"%s\",\"jobs\":%d,\"iterations\":%ld,"
+                 "\"ns_per_op\":%.1f,\"min_ns_per_op\":%.1f}",
+            first ? "" : ",", name, arg, jobs, iters, ns[reps / 2], ns[0]);
+    first = 0;
+    fflush(out);
+}
+
+static void bench_cmd_parse(const char *arg, const char *line, long iters, int reps)
+{
+    double ns[REPS];
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t start = stats_now();
+        for (long i = 0; i < iters; i++)
+        {
+            char **argv = cmd_parse(line);
+            sink += (size_t)argv[0];
+            cmd_free(argv);
+        }
+        ns[r] = (double)(stats_now() - start) / (double)iters;
+    }
+    report("cmd_parse", arg, 0, iters, ns, reps);
+}
+
+// trim_white works in place, so every call gets a fresh copy of the line
+static void bench_trim_white(const char *arg, const char *line, long iters, int reps)
+{
+    double ns[REPS];
+    size_t len = strlen(line) + 1;
+    char *buf = malloc(len);
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t start = stats_now();
+        for (long i = 0; i < iters; i++)
+        {
+            memcpy(buf, line, len);
+            sink += (size_t)trim_white(buf)[0];
+        }
+        ns[r] = (double)(stats_now() - start) / (double)iters;
+    }
+    free(buf);
+    report("trim_white", arg, 0, iters, ns, reps);
+}
+
+static void bench_get_prompt(const char *arg, const char *prompt, long iters, int reps)
+{
+    double ns[REPS];
+    if (prompt != NULL)
+    {
+        setenv("BENCH_PROMPT", prompt, 1);
+    }
+    else
+    {
+        unsetenv("BENCH_PROMPT");
+    }
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t start = stats_now();
+        for (long i = 0; i < iters; i++)
+        {
+            char *p = get_prompt("BENCH_PROMPT");
+            sink += (size_t)p[0];
+            free(p);
+        }
+        ns[r] = (double)(stats_now() - start) / (double)iters;
+    }
+    report("get_prompt", arg, 0, iters, ns, reps);
+}
+
+static void bench_do_builtin(struct shell *sh, const char *arg, char **argv, long iters, int reps)
+{
+    double ns[REPS];
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t start = stats_now();
+        for (long i = 0; i < iters; i++)
+        {
+            sink += do_builtin(sh, argv);
+        }
+        ns[r] = (double)(stats_now() - start) / (double)iters;
+    }
+    report("do_builtin", arg, 0, iters, ns, reps);
+}
+
+static void fill_jobs(int n)
+{
+    char *argv[] = {"sleep", "100", NULL};
+    for (int i = 0; i < n; i++)
+    {
+        add_job(FAKE_PID + i, argv);
+    }
+}
+
+static void bench_jobs(int n, int reps)
+{
+    double ns[REPS];
+
+    // Filling an empty table, which grows by doubling on the way
+    for (int r = 0; r < reps; r++)
+    {
+        cleanup_jobs();
+        uint64_t start = stats_now();
+        fill_jobs(n);
+        ns[r] = (double)(stats_now() - start) / n;
+    }
+    report("add_job", "fill", n, n, ns, reps);
+
+    // What every prompt pays when nothing finished
+    long iters = 1000000;
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t start = stats_now();
+        for (long i = 0; i < iters; i++)
+        {
+            sink += (size_t)check_jobs();
+        }
+        ns[r] = (double)(stats_now() - start) / (double)iters;
+    }
+    report("check_jobs", "idle", n, iters, ns, reps);
+
+    // Reaping one real job among the others; only check_jobs is timed
+    iters = 200;
+    char *argv[] = {"true", NULL};
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t total = 0;
+        for (long i = 0; i < iters; i++)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                _exit(0);
+            }
+            add_job(pid, argv);
+            siginfo_t info;
+            waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT);
+            uint64_t start = stats_now();
+            sink += (size_t)check_jobs();
+            total += stats_now() - start;
+        }
+        ns[r] = (double)total / (double)iters;
+    }
+    report("check_jobs", "reap", n, iters, ns, reps);
+
+    iters = n < 100000 ? 1000000 / n : 10;
+    for (int r = 0; r < reps; r++)
+    {
+        uint64_t start = stats_now();
+        for (long i = 0; i < iters; i++)
+        {
+            show_jobs();
+        }
+        fflush(stdout);
+        ns[r] = (double)(stats_now() - start) / (double)iters;
+    }
+    report("show_jobs", "list", n, iters, ns, reps);
+
+    cleanup_jobs();
+}
+
+int main(int argc, char **argv)
+{
+    int reps = argc > 1 ? atoi(argv[1]) : REPS;
+    if (reps <= 0 || reps > REPS)
+    {
+        reps = REPS;
+    }
+    setenv("MY_JOB_EVENTS", "sigchld", 1);
+
+    // The JSON keeps the real stdout, the job listings go to /dev/null
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    if (out == NULL || null < 0)
+    {
+        perror("bench-lab");
+        return 1;
+    }
+    dup2(null, STDOUT_FILENO);
+    close(null);
+
+    size_t long_len = 4096;
+    char *long_line = malloc(long_len + 1);
+    for (size_t i = 0; i < long_len; i++)
+    {
+        long_line[i] = (i % 9 == 8) ? ' ' : (char)('a' + i % 26);
+    }
+    long_line[long_len] = '\0';
+
+    fprintf(out, "{\"benchmark\":\"bench-lab\",\"reps\":%d,\"results\":[", reps);
+
+    bench_cmd_parse("short", "ls -a -l", 1000000, reps);
+    bench_cmd_parse("quoted", "grep -n \"two words\" 'a b' c\\ d file.txt", 1000000, reps);
+    bench_cmd_parse("long", long_line, 20000, reps);
+
+    bench_trim_white("short", "   ls -a   ", 1000000, reps);
+    bench_trim_white("none", "ls -a", 1000000, reps);
+    bench_trim_white("long", long_line, 100000, reps);
+
+    bench_get_prompt("set", "bench> ", 1000000, reps);
+    bench_get_prompt("unset", NULL, 1000000, reps);
+
+    struct shell sh = {0};
+    char *hit[] = {"true", NULL};
+    char *miss[] = {"ls", "-l", NULL};
+    bench_do_builtin(&sh, "builtin", hit, 1000000, reps);
+    bench_do_builtin(&sh, "external", miss, 1000000, reps);
+
+    int sizes[] = {10, 1000, 100000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench_jobs(sizes[i], reps);
+    }
+
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    free(long_line);
+    return 0;
+}
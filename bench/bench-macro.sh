@@ -0,0 +1,80 @@
+#!/bin/sh
+# End to end: the same command files run as scripts by each shell, for the
+# workloads a CI runner's /bin/sh sees. The shell has no loop construct, so
+# every workload is unrolled into a file of one command per line:
+#
+#   spawn     /bin/true, a fork (or spawn) and exec per line
+#   fanout    /bin/true & as background jobs; no shell waits for them
+#   pipeline  an 8 stage echo | cat | ... pipeline per line
+#   cdpwd     cd and pwd back and forth, built ins only
+#   lines     distinct lines of : with arguments, parsing only
+#
+# No shell keeps history when it runs a script, so lines stands in for
+# history growth: every line is new text the shell has to read and parse.
+#
+# Each shell runs each workload -r times, and each run gives one mean
+# latency: its time over its number of commands. The report has commands
+# per second from the median run, and the spread of those per-run means
+# (min, p50, p90, max), not of single commands, which dash and bash give
+# no way to time from outside. Startup is included, so compare with
+# bench-startup.sh when n is small.
+#
+# usage: bench/bench-macro.sh [-n commands] [-j jobs] [-r runs] [shell...]
+# Build the shells without sanitizers (BENCH_CFLAGS) for meaningful numbers.
+
+cmds=5000
+jobs=1000
+runs=20
+while getopts n:j:r: opt; do
+    case $opt in
+    n) cmds=$OPTARG ;;
+    j) jobs=$OPTARG ;;
+    r) runs=$OPTARG ;;
+    *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 0 ] && set -- ./myprogram /bin/dash /bin/bash
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+awk -v n="$cmds" 'BEGIN { for (i = 0; i < n; i++) print "/bin/true" }' >"$dir/spawn"
+awk -v n="$jobs" 'BEGIN { for (i = 0; i < n; i++) print "/bin/true &" }' >"$dir/fanout"
+awk -v n="$cmds" 'BEGIN {
+    for (i = 0; i < n / 10; i++)
+        print "echo " i " | cat | cat | cat | cat | cat | cat | cat"
+}' >"$dir/pipeline"
+awk -v n="$cmds" 'BEGIN {
+    for (i = 0; i < n; i += 4)
+        print "cd /tmp\npwd\ncd /\npwd"
+}' >"$dir/cdpwd"
+awk -v n="$cmds" 'BEGIN {
+    for (i = 0; i < n; i++)
+        printf ": line %d with a few words and \"a quoted %d\" argument\n", i, i * 7
+}' >"$dir/lines"
+
+now() { date +%s%N; }
+
+for w in spawn fanout pipeline cdpwd lines; do
+    n=$(wc -l <"$dir/$w")
+    echo "$w: $n commands, $runs runs"
+    for sh in "$@"; do
+        "$sh" -c true || { echo "$sh: -c true failed" >&2; continue; }
+        times=
+        for r in $(seq "$runs"); do
+            start=$(now)
+            "$sh" "$dir/$w" >/dev/null 2>&1
+            times="$times $(($(now) - start))"
+        done
+        echo "$times" | tr ' ' '\n' | sed '/^$/d' | sort -n | awk -v sh="$sh" -v n="$n" '
+            { ns[NR] = $1 }
+            END {
+                # Nearest rank
+                p50 = ns[int((NR + 1) / 2)]
+                p90 = ns[NR * 0.9 == int(NR * 0.9) ? NR * 0.9 : int(NR * 0.9) + 1]
+                printf "  %-20s %10.0f cmds/s  per-run mean us/cmd min %8.2f p50 %8.2f p90 %8.2f max %8.2f\n",
+                    sh, n / (p50 / 1e9), ns[1] / n / 1e3, p50 / n / 1e3, p90 / n / 1e3, ns[NR] / n / 1e3
+            }'
+    done
+done
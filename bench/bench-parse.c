@@ -0,0 +1,107 @@
+/**
+ * Benchmark for cmd_parse. Reports the number of heap allocations and the
+ * time spent per parsed line. Build with `make bench-parse` (no sanitizers,
+ * the allocator hooks below would fight with ASAN's interceptors).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/lab.h"
+#include "../src/scan.h"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static size_t n_allocs = 0;
+static size_t n_bytes = 0;
+
+// Count every allocation made by the process, including the ones libc
+// makes internally (strdup and friends call malloc through the PLT).
+void *malloc(size_t size)
+{
+    n_allocs++;
+    n_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    n_allocs++;
+    n_bytes += nmemb * size;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    n_allocs++;
+    n_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name, const char *line, int iters)
+{
+    size_t allocs = n_allocs;
+    size_t bytes = n_bytes;
+    double start = now_ns();
+
+    for (int i = 0; i < iters; i++)
+    {
+        char **argv = cmd_parse(line);
+        cmd_free(argv);
+    }
+
+    double elapsed = now_ns() - start;
+    printf("%-10s allocs/line %6.2f  bytes/line %9.1f  ns/line %9.1f\n", name,
+           (double)(n_allocs - allocs) / iters,
+           (double)(n_bytes - bytes) / iters,
+           elapsed / iters);
+}
+
+int main(int argc, char **argv)
+{
+    int iters = argc > 1 ? atoi(argv[1]) : 100000;
+    if (iters <= 0)
+    {
+        iters = 100000;
+    }
+
+    // A long generated line, like the ones our tooling pastes in
+    size_t long_len = 32 * 1024;
+    char *long_line = __libc_malloc(long_len + 1);
+    for (size_t i = 0; i < long_len; i++)
+    {
+        long_line[i] = (i % 9 == 8) ? ' ' : (char)('a' + i % 26);
+    }
+    long_line[long_len] = '\0';
+
+    const char *impls[] = {"scalar", "sse2", "avx2"};
+    for (size_t m = 0; m < sizeof(impls) / sizeof(impls[0]); m++)
+    {
+        if (scan_set_impl(impls[m]) != 0)
+        {
+            continue;
+        }
+        printf("scanner: %s\n", impls[m]);
+        run("short", "ls -a -l", iters);
+        run("medium", "grep -rn --include=*.c cmd_parse src tests app", iters);
+        run("long", long_line, iters / 100 > 0 ? iters / 100 : 1);
+    }
+
+    __libc_free(long_line);
+    return 0;
+}
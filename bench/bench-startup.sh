@@ -0,0 +1,34 @@
+#!/bin/sh
+# Cold start to exit: how long `shell -c true` takes, averaged over many
+# launches. The loop overhead is the same for every shell measured, so
+# compare the shells against each other rather than reading the numbers
+# as absolute.
+#
+# usage: bench/bench-startup.sh [-n launches] [shell...]
+# Build the shells without sanitizers (BENCH_CFLAGS) for meaningful numbers.
+
+launches=2000
+while getopts n: opt; do
+    case $opt in
+    n) launches=$OPTARG ;;
+    *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 0 ] && set -- ./myprogram
+
+now() { date +%s%N; }
+
+for sh in "$@"; do
+    "$sh" -c true || { echo "$sh: -c true failed" >&2; continue; }
+    start=$(now)
+    i=0
+    while [ "$i" -lt "$launches" ]; do
+        "$sh" -c true
+        i=$((i + 1))
+    done
+    ns=$(($(now) - start))
+    awk -v sh="$sh" -v n="$launches" -v ns="$ns" 'BEGIN {
+        printf "%-24s %6d launches %8.1f us/launch\n", sh, n, ns / n / 1e3
+    }'
+done
@@ -0,0 +1,41 @@
+#!/bin/sh
+# A conditional-heavy script: every iteration runs test, [ and echo, which
+# cost a fork and exec each unless the shell has them built in. The shell
+# has no loop construct, so the loop is unrolled into a command file.
+#
+# usage: bench/bench-test.sh [-n iterations] [-r runs] [shell...]
+# Build the shells without sanitizers (BENCH_CFLAGS) for meaningful numbers.
+
+iters=100000
+runs=3
+while getopts n:r: opt; do
+    case $opt in
+    n) iters=$OPTARG ;;
+    r) runs=$OPTARG ;;
+    *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 0 ] && set -- ./myprogram
+
+cmds=$(mktemp)
+trap 'rm -f "$cmds"' EXIT
+awk -v n="$iters" 'BEGIN {
+    for (i = 0; i < n; i++)
+        printf "[ -f /etc/passwd ] && test %d -lt 50000 && echo lo || echo hi\n", i
+}' >"$cmds"
+
+now() { date +%s%N; }
+
+for sh in "$@"; do
+    best=
+    for r in $(seq "$runs"); do
+        start=$(now)
+        "$sh" "$cmds" >/dev/null 2>&1
+        ns=$(($(now) - start))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then best=$ns; fi
+    done
+    awk -v sh="$sh" -v n="$iters" -v ns="$best" 'BEGIN {
+        printf "%-24s %8d iterations %10.1f ms %8.2f us/iteration\n", sh, n, ns / 1e6, ns / 1e3 / n
+    }'
+done
@@ -0,0 +1,110 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <stdio.h>
+
+#define ARENA_DEFAULT_CHUNK (16 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+// Every size is rounded to ARENA_ALIGN, so only the start of data matters
+_Static_assert(offsetof(struct arena_chunk, data) % ARENA_ALIGN == 0, "chunk data must be aligned");
+
+void arena_init(struct arena *a, size_t chunk_size)
+{
+    a->head = NULL;
+    a->cur = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+}
+
+static struct arena_chunk *chunk_new(size_t size)
+{
+    struct arena_chunk *c = malloc(sizeof(struct arena_chunk) + size);
+    if (c == NULL)
+    {
+        perror("malloc failed");
+        return NULL;
+    }
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    // Walk forward through chunks kept from earlier rounds before growing
+    while (a->cur != NULL && a->cur->size - a->cur->used < size)
+    {
+        if (a->cur->next == NULL)
+        {
+            break;
+        }
+        a->cur = a->cur->next;
+        a->cur->used = 0;
+    }
+
+    if (a->cur == NULL || a->cur->size - a->cur->used < size)
+    {
+        // A zeroed arena gets the default chunk size
+        size_t want = a->chunk_size ? a->chunk_size : ARENA_DEFAULT_CHUNK;
+        size_t chunk = size > want ? size : want;
+        struct arena_chunk *c = chunk_new(chunk);
+        if (c == NULL)
+        {
+            return NULL;
+        }
+        // Insert after the current chunk so the spare chunks stay in order
+        if (a->cur == NULL)
+        {
+            c->next = a->head;
+            a->head = c;
+        }
+        else
+        {
+            c->next = a->cur->next;
+            a->cur->next = c;
+        }
+        a->cur = c;
+    }
+
+    void *p = a->cur->data + a->cur->used;
+    a->cur->used += size;
+    return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t n)
+{
+    char *copy = arena_alloc(a, n + 1);
+    if (copy != NULL)
+    {
+        memcpy(copy, s, n);
+        copy[n] = '\0';
+    }
+    return copy;
+}
+
+void arena_reset(struct arena *a)
+{
+    // Later chunks have their used count cleared when arena_alloc reaches them
+    a->cur = a->head;
+    if (a->cur != NULL)
+    {
+        a->cur->used = 0;
+    }
+}
+
+void arena_destroy(struct arena *a)
+{
+    struct arena_chunk *c = a->head;
+    while (c != NULL)
+    {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->head = NULL;
+    a->cur = NULL;
+}
@@ -0,0 +1,80 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stdalign.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    struct arena_chunk
+    {
+        struct arena_chunk *next;
+        size_t size;
+        size_t used;
+        alignas(max_align_t) char data[]; // keeps the first allocation aligned
+    };
+
+    /**
+     * A bump allocator. Memory is carved out of large chunks and is never
+     * freed piecemeal; arena_reset releases everything at once in O(1) by
+     * rewinding to the first chunk. The chunks themselves are kept for the
+     * next round so a steady workload stops calling malloc altogether.
+     * A zeroed struct arena is an empty arena with the default chunk size.
+     */
+    struct arena
+    {
+        struct arena_chunk *head;
+        struct arena_chunk *cur;
+        size_t chunk_size;
+    };
+
+    /**
+     * @brief Initialize an empty arena. No memory is allocated until the
+     * first call to arena_alloc.
+     *
+     * @param a The arena
+     * @param chunk_size The default size of each chunk, 0 for the default
+     */
+    void arena_init(struct arena *a, size_t chunk_size);
+
+    /**
+     * @brief Allocate size bytes aligned for any type. The memory is valid
+     * until the next arena_reset or arena_destroy.
+     *
+     * @param a The arena
+     * @param size The number of bytes
+     * @return The memory, or NULL if malloc failed
+     */
+    void *arena_alloc(struct arena *a, size_t size);
+
+    /**
+     * @brief Copy n bytes of s into the arena and NUL terminate them.
+     *
+     * @param a The arena
+     * @param s The bytes to copy
+     * @param n The number of bytes
+     * @return The copy, or NULL if malloc failed
+     */
+    char *arena_strndup(struct arena *a, const char *s, size_t n);
+
+    /**
+     * @brief Release every allocation made from the arena at once.
+     *
+     * @param a The arena
+     */
+    void arena_reset(struct arena *a);
+
+    /**
+     * @brief Free all the chunks owned by the arena.
+     *
+     * @param a The arena
+     */
+    void arena_destroy(struct arena *a);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
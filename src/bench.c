@@ -0,0 +1,213 @@
+#include "builtin.h"
+#include "usage.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+/*
+ * bench [-n N] [-w warmup] command [arg...]
+ * bench [-n N] [-w warmup] 'command line'
+ *
+ * Runs the command warmup times unmeasured, then N times, each time through
+ * execute like any line the user types, so what is measured is the shell's
+ * own path from a parsed command to its exit: PATH lookup, spawn (in the
+ * current MY_SPAWN mode), exec and wait. A single argument is parsed as a
+ * command line, which allows pipelines and redirections.
+ *
+ * Wall time comes from the monotonic clock and resource usage from the
+ * wait4 of each run. The command's stdout is discarded while it runs.
+ * Outliers are runs outside 1.5 interquartile ranges of the quartiles.
+ */
+#define BENCH_RUNS 100
+#define BENCH_WARMUP 3
+#define BENCH_USAGE 2
+
+static int parse_count(const char *arg)
+{
+    char *end;
+    errno = 0;
+    long n = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE || n < 0 || n > INT_MAX)
+    {
+        return -1;
+    }
+    return (int)n;
+}
+
+static int by_value(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank of sorted samples
+static uint64_t percentile(const uint64_t *sorted, int n, double p)
+{
+    int rank = (int)ceil(p / 100.0 * n);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Run the tree once with stdout discarded; 0 or the status it failed with
+static int run_once(struct shell *sh, struct node *tree, int quiet, uint64_t *ns, struct rusage *used)
+{
+    int saved = dup(STDOUT_FILENO);
+    fflush(stdout);
+    dup2(quiet, STDOUT_FILENO);
+
+    struct rusage *outer = sh->usage;
+    memset(used, 0, sizeof(*used));
+    sh->usage = used;
+    uint64_t start = stats_now();
+    int status = execute(sh, tree);
+    *ns = stats_now() - start;
+    sh->usage = outer;
+    if (outer != NULL)
+    {
+        usage_add(outer, used);
+    }
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return status;
+}
+
+static void report(const char *name, uint64_t *samples, int n, int warmup, const struct rusage *used)
+{
+    double mean = 0;
+    for (int i = 0; i < n; i++)
+    {
+        mean += (double)samples[i];
+    }
+    mean /= n;
+    double var = 0;
+    for (int i = 0; i < n; i++)
+    {
+        var += ((double)samples[i] - mean) * ((double)samples[i] - mean);
+    }
+    double stddev = n > 1 ? sqrt(var / (n - 1)) : 0;
+
+    qsort(samples, (size_t)n, sizeof(samples[0]), by_value);
+    double q1 = (double)percentile(samples, n, 25);
+    double q3 = (double)percentile(samples, n, 75);
+    int low = 0, high = 0;
+    for (int i = 0; i < n; i++)
+    {
+        low += (double)samples[i] < q1 - 1.5 * (q3 - q1);
+        high += (double)samples[i] > q3 + 1.5 * (q3 - q1);
+    }
+
+    char a[32], b[32];
+    printf("bench: %s, %d runs after %d warmup\n", name, n, warmup);
+    printf("  mean     %s ± %s\n", stats_format(a, sizeof(a), (uint64_t)mean),
+           stats_format(b, sizeof(b), (uint64_t)stddev));
+    printf("  min      %s\n", stats_format(a, sizeof(a), samples[0]));
+    printf("  p50      %s\n", stats_format(a, sizeof(a), percentile(samples, n, 50)));
+    printf("  p99      %s\n", stats_format(a, sizeof(a), percentile(samples, n, 99)));
+    printf("  max      %s\n", stats_format(a, sizeof(a), samples[n - 1]));
+    printf("  outliers %d (%d low, %d high)\n", low + high, low, high);
+
+    // Per run, as wait4 saw the children
+    double user = ((double)used->ru_utime.tv_sec * 1e9 + (double)used->ru_utime.tv_usec * 1e3) / n;
+    double sys = ((double)used->ru_stime.tv_sec * 1e9 + (double)used->ru_stime.tv_usec * 1e3) / n;
+    printf("  user     %s  sys %s  maxrss %ld KB\n", stats_format(a, sizeof(a), (uint64_t)user),
+           stats_format(b, sizeof(b), (uint64_t)sys), used->ru_maxrss);
+    printf("  ctxsw    %.1f voluntary, %.1f involuntary  faults %.1f minor, %.1f major\n",
+           (double)used->ru_nvcsw / n, (double)used->ru_nivcsw / n, (double)used->ru_minflt / n,
+           (double)used->ru_majflt / n);
+}
+
+int builtin_bench(struct shell *sh, char **argv)
+{
+    int runs = BENCH_RUNS;
+    int warmup = BENCH_WARMUP;
+    int i = 1;
+
+    while (argv[i] != NULL && (strncmp(argv[i], "-n", 2) == 0 || strncmp(argv[i], "-w", 2) == 0))
+    {
+        int *count = argv[i][1] == 'n' ? &runs : &warmup;
+        const char *arg = argv[i][2] != '\0' ? argv[i] + 2 : argv[++i];
+        if (arg == NULL || (*count = parse_count(arg)) < 0)
+        {
+            fprintf(stderr, "bench: -%c: expected a number\n", count == &runs ? 'n' : 'w');
+            return BENCH_USAGE;
+        }
+        i++;
+    }
+    if (argv[i] != NULL && strcmp(argv[i], "--") == 0)
+    {
+        i++;
+    }
+    if (argv[i] == NULL || runs == 0)
+    {
+        fprintf(stderr, "bench: usage: bench [-n N] [-w warmup] command [arg...]\n");
+        return BENCH_USAGE;
+    }
+
+    // One word is a whole command line, several are the words of a command
+    struct node cmd = {.type = NODE_COMMAND};
+    struct node *tree = &cmd;
+    if (argv[i + 1] == NULL)
+    {
+        if (parse_line(&sh->mem, argv[i], &tree) < 0)
+        {
+            return BENCH_USAGE;
+        }
+        if (tree == NULL)
+        {
+            fprintf(stderr, "bench: empty command\n");
+            return BENCH_USAGE;
+        }
+    }
+    else
+    {
+        cmd.cmd.argv = argv + i;
+        while (argv[i + cmd.cmd.argc] != NULL)
+        {
+            cmd.cmd.argc++;
+        }
+    }
+
+    uint64_t *samples = malloc(sizeof(uint64_t) * (size_t)runs);
+    int quiet = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (samples == NULL || quiet < 0)
+    {
+        fprintf(stderr, "bench: %s\n", strerror(samples == NULL ? ENOMEM : errno));
+        free(samples);
+        if (quiet >= 0)
+        {
+            close(quiet);
+        }
+        return 1;
+    }
+
+    struct rusage total = {0};
+    int status = 0;
+    for (int r = 0; r < warmup + runs && status == 0; r++)
+    {
+        uint64_t ns;
+        struct rusage used;
+        status = run_once(sh, tree, quiet, &ns, &used);
+        if (r >= warmup)
+        {
+            samples[r - warmup] = ns;
+            usage_add(&total, &used);
+            // usage_add keeps the largest max RSS, the rest adds up
+        }
+        if (status != 0)
+        {
+            fprintf(stderr, "bench: %s: exit status %d on run %d\n", argv[i], status, r + 1);
+        }
+    }
+    if (status == 0)
+    {
+        report(argv[i], samples, runs, warmup, &total);
+    }
+
+    close(quiet);
+    free(samples);
+    return status;
+}
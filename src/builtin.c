@@ -0,0 +1,304 @@
+#include "builtin.h"
+#include "trace.h"
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <readline/history.h>
+
+static int builtin_exit(struct shell *sh, char **argv)
+{
+    // exit [n], by default with the status of the last command
+    int status = argv[1] != NULL ? atoi(argv[1]) & 0xff : sh->last_status;
+    sh_destroy(sh);
+    exit(status);
+}
+
+static int builtin_cd(struct shell *sh, char **argv)
+{
+    (void)sh;
+    return change_dir(argv) == 0 ? 0 : 1;
+}
+
+static int builtin_pwd(struct shell *sh, char **argv)
+{
+    (void)sh;
+    (void)argv;
+    char cwd[PATH_MAX];
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        printf("Error: %s\n", strerror(errno));
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+static int builtin_history(struct shell *sh, char **argv)
+{
+    (void)sh;
+    (void)argv;
+    HIST_ENTRY **h_list = history_list();
+    if (h_list)
+    {
+        for (int i = 0; h_list[i]; i++)
+        {
+            printf("%d %s\n", i + history_base, h_list[i]->line);
+        }
+    }
+    else
+    {
+        printf(" No History");
+    }
+    return 0;
+}
+
+// jobs [-l]: -l adds the jobs that finished lately and what they used
+static int builtin_jobs(struct shell *sh, char **argv)
+{
+    (void)sh;
+    if (argv[1] != NULL && strcmp(argv[1], "-l") == 0)
+    {
+        show_jobs_long();
+    }
+    else
+    {
+        show_jobs();
+    }
+    return 0;
+}
+
+static int builtin_hash(struct shell *sh, char **argv)
+{
+    if (argv[1] == NULL)
+    {
+        path_print(&sh->paths);
+        return 0;
+    }
+    if (strcmp(argv[1], "-r") == 0)
+    {
+        path_clear(&sh->paths);
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; argv[i] != NULL; i++)
+    {
+        if (path_lookup(&sh->paths, argv[i], false) == NULL)
+        {
+            fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// maxjobs [N]: show or set how many background jobs run at once, 0 for no limit
+static int builtin_maxjobs(struct shell *sh, char **argv)
+{
+    (void)sh;
+    if (argv[1] == NULL)
+    {
+        int max = jobs_limit();
+        if (max == 0)
+        {
+            printf("unlimited\n");
+        }
+        else
+        {
+            printf("%d\n", max);
+        }
+        return 0;
+    }
+
+    char *end;
+    errno = 0;
+    long max = strtol(argv[1], &end, 10);
+    if (end == argv[1] || *end != '\0' || errno == ERANGE || max < 0 || max > INT_MAX)
+    {
+        fprintf(stderr, "maxjobs: %s: invalid number\n", argv[1]);
+        return 1;
+    }
+    jobs_set_limit((int)max);
+    return 0;
+}
+
+// stats [-r]: where the time of each command line went, or start over
+static int builtin_stats(struct shell *sh, char **argv)
+{
+    if (argv[1] == NULL)
+    {
+        stats_print(&sh->stats, stdout);
+        return 0;
+    }
+    if (strcmp(argv[1], "-r") == 0 && argv[2] == NULL)
+    {
+        stats_reset(&sh->stats);
+        return 0;
+    }
+    fprintf(stderr, "stats: usage: stats [-r]\n");
+    return 2;
+}
+
+// trace start FILE | trace stop: a timeline of everything the shell runs
+static int builtin_trace(struct shell *sh, char **argv)
+{
+    (void)sh;
+    if (argv[1] != NULL && strcmp(argv[1], "start") == 0 && argv[2] != NULL && argv[3] == NULL)
+    {
+        if (trace_file() != NULL)
+        {
+            fprintf(stderr, "trace: already tracing to %s\n", trace_file());
+            return 1;
+        }
+        if (trace_start(argv[2]) < 0)
+        {
+            fprintf(stderr, "trace: %s: %s\n", argv[2], strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+    if (argv[1] != NULL && strcmp(argv[1], "stop") == 0 && argv[2] == NULL)
+    {
+        long dropped = trace_stop();
+        if (dropped < 0)
+        {
+            fprintf(stderr, "trace: not tracing\n");
+            return 1;
+        }
+        if (dropped > 0)
+        {
+            fprintf(stderr, "trace: %ld events dropped\n", dropped);
+        }
+        return 0;
+    }
+    fprintf(stderr, "trace: usage: trace start FILE | trace stop\n");
+    return 2;
+}
+
+static int builtin_true(struct shell *sh, char **argv)
+{
+    (void)sh;
+    (void)argv;
+    return 0;
+}
+
+static int builtin_false(struct shell *sh, char **argv)
+{
+    (void)sh;
+    (void)argv;
+    return 1;
+}
+
+// Adding a built in command is one line here
+static const struct builtin builtins[] = {
+    {"exit", builtin_exit},
+    {"cd", builtin_cd},
+    {"pwd", builtin_pwd},
+    {"history", builtin_history},
+    {"jobs", builtin_jobs},
+    {"hash", builtin_hash},
+    {"echo", builtin_echo},
+    {"printf", builtin_printf},
+    {"test", builtin_test},
+    {"[", builtin_test},
+    {"true", builtin_true},
+    {"false", builtin_false},
+    {":", builtin_true},
+    {"maxjobs", builtin_maxjobs},
+    {"parallel", builtin_parallel},
+    {"stats", builtin_stats},
+    {"trace", builtin_trace},
+    {"bench", builtin_bench},
+};
+
+#define N_BUILTINS (sizeof(builtins) / sizeof(builtins[0]))
+// Power of two and at least twice the table so probes stay short
+#define BUILTIN_SLOTS 64
+
+_Static_assert(N_BUILTINS * 2 <= BUILTIN_SLOTS, "grow BUILTIN_SLOTS");
+_Static_assert(N_BUILTINS < 255, "slot entries are one byte");
+
+// Index + 1 into builtins, 0 for an empty slot
+static unsigned char slots[BUILTIN_SLOTS];
+static bool slots_ready;
+// The longest built in name, so nothing longer is ever hashed
+static size_t name_max;
+
+// FNV-1a over a name already known to be at most name_max long
+static unsigned hash_builtin(const char *name, size_t len)
+{
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h & (BUILTIN_SLOTS - 1);
+}
+
+static void build_slots(void)
+{
+    for (size_t i = 0; i < N_BUILTINS; i++)
+    {
+        size_t len = strlen(builtins[i].name);
+        if (len > name_max)
+        {
+            name_max = len;
+        }
+        unsigned s = hash_builtin(builtins[i].name, len);
+        while (slots[s] != 0)
+        {
+            s = (s + 1) & (BUILTIN_SLOTS - 1);
+        }
+        slots[s] = (unsigned char)(i + 1);
+    }
+    slots_ready = true;
+}
+
+const struct builtin *builtin_find(const char *name)
+{
+    if (!slots_ready)
+    {
+        build_slots();
+    }
+
+    // No builtin name is longer, so this bounds the work for any command
+    size_t len = strnlen(name, name_max + 1);
+    if (len == 0 || len > name_max)
+    {
+        return NULL;
+    }
+    for (unsigned s = hash_builtin(name, len); slots[s] != 0; s = (s + 1) & (BUILTIN_SLOTS - 1))
+    {
+        const struct builtin *b = &builtins[slots[s] - 1];
+        if (strcmp(b->name, name) == 0)
+        {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+bool is_builtin(const char *name)
+{
+    return builtin_find(name) != NULL;
+}
+
+bool do_builtin(struct shell *sh, char **argv)
+{
+    if (argv == NULL || argv[0] == NULL)
+    {
+        return false;
+    }
+
+    uint64_t start = stats_now();
+    const struct builtin *b = builtin_find(argv[0]);
+    if (b == NULL)
+    {
+        return false;
+    }
+    sh->last_status = b->run(sh, argv);
+    stats_record(&sh->stats, STAT_BUILTIN, start, argv[0]);
+    return true;
+}
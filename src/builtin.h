@@ -0,0 +1,58 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Handlers for the built in table in builtin.c that live in their own
+     * files. Each one takes the full argv, including the command name, and
+     * returns the exit status of the command.
+     */
+
+    /**
+     * @brief echo [-neE] [string...], the same as coreutils echo: -n drops
+     * the newline, -e turns on backslash escapes and -E turns them off.
+     */
+    int builtin_echo(struct shell *sh, char **argv);
+
+    /**
+     * @brief POSIX printf format [argument...]. The format is reused until
+     * every argument is consumed.
+     */
+    int builtin_printf(struct shell *sh, char **argv);
+
+    /**
+     * @brief POSIX test and [ with the usual file, string and integer
+     * operators, ! ( ) -a and -o. Returns 0 for true, 1 for false and 2 on
+     * a usage error.
+     */
+    int builtin_test(struct shell *sh, char **argv);
+
+    /**
+     * @brief parallel [-j N] command [arg...] [::: item...] runs command
+     * once per item, or per line of stdin without :::, N at a time. Each
+     * item replaces {} in the arguments or is appended to them. Output is
+     * grouped per task. Returns the number of failed tasks, at most 101,
+     * or 255 on a usage error.
+     */
+    int builtin_parallel(struct shell *sh, char **argv);
+
+    /**
+     * @brief bench [-n N] [-w warmup] command [arg...] runs command warmup
+     * times, then N times more through execute with its stdout discarded,
+     * and prints mean, stddev, min, p50, p99, max and outliers of the wall
+     * time along with what wait4 reported. A single argument is parsed as
+     * a command line. Returns 0, the status of the first run that failed,
+     * or 2 on a usage error.
+     */
+    int builtin_bench(struct shell *sh, char **argv);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
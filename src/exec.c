@@ -0,0 +1,717 @@
+#define _GNU_SOURCE
+#include "lab.h"
+#include "trace.h"
+#include "usage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+// A descriptor the shell moved out of the way while a built in ran with
+// redirections; copy is -1 when the descriptor was not open before.
+struct saved_fd
+{
+    int fd;
+    int copy;
+};
+
+static int wait_status(int status)
+{
+    if (WIFEXITED(status))
+    {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status))
+    {
+        return 128 + WTERMSIG(status);
+    }
+    if (WIFSTOPPED(status))
+    {
+        return 128 + WSTOPSIG(status);
+    }
+    return 1;
+}
+
+static int open_redir(struct redir *r)
+{
+    switch (r->type)
+    {
+    case REDIR_IN:
+        return open(r->path, O_RDONLY | O_CLOEXEC);
+    case REDIR_OUT:
+    case REDIR_OUT_ERR:
+        return open(r->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    default:
+        return open(r->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    }
+}
+
+static void save_fd(struct saved_fd *saved, int *n_saved, int fd)
+{
+    if (saved == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < *n_saved; i++)
+    {
+        if (saved[i].fd == fd)
+        {
+            return;
+        }
+    }
+    saved[*n_saved].fd = fd;
+    saved[*n_saved].copy = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    (*n_saved)++;
+}
+
+/*
+ * Apply the redirections of a command to the current process, in order.
+ * When saved is not NULL every descriptor is copied first so that
+ * restore_fds can undo the redirections after a built in has run.
+ */
+static int redirect_fds(struct redir *r, struct saved_fd *saved, int *n_saved)
+{
+    for (; r != NULL; r = r->next)
+    {
+        save_fd(saved, n_saved, r->fd);
+        if (r->type == REDIR_CLOSE)
+        {
+            close(r->fd);
+            continue;
+        }
+        if (r->type == REDIR_DUP)
+        {
+            if (dup2(r->target_fd, r->fd) < 0)
+            {
+                fprintf(stderr, "%d: %s\n", r->target_fd, strerror(errno));
+                return -1;
+            }
+            continue;
+        }
+
+        int src = open_redir(r);
+        if (src < 0)
+        {
+            fprintf(stderr, "%s: %s\n", r->path, strerror(errno));
+            return -1;
+        }
+        if (r->type == REDIR_OUT_ERR || r->type == REDIR_APPEND_ERR)
+        {
+            save_fd(saved, n_saved, STDERR_FILENO);
+            dup2(src, STDERR_FILENO);
+        }
+        if (src != r->fd)
+        {
+            dup2(src, r->fd);
+            close(src);
+        }
+        else
+        {
+            // Opened straight onto the target, keep it across exec
+            fcntl(src, F_SETFD, 0);
+        }
+    }
+    return 0;
+}
+
+static void restore_fds(struct saved_fd *saved, int n_saved)
+{
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = n_saved - 1; i >= 0; i--)
+    {
+        if (saved[i].copy < 0)
+        {
+            close(saved[i].fd);
+        }
+        else
+        {
+            dup2(saved[i].copy, saved[i].fd);
+            close(saved[i].copy);
+        }
+    }
+}
+
+static int count_redirs(struct redir *r)
+{
+    int n = 0;
+    for (; r != NULL; r = r->next)
+    {
+        n += 2;
+    }
+    return n;
+}
+
+/*
+ * Child side setup shared by every process the shell forks: join the
+ * process group of the job, take the terminal for foreground jobs and put
+ * back the signals the interactive shell ignores.
+ */
+static void child_setup(struct shell *sh, pid_t pgid, bool background)
+{
+    if (sh->shell_is_interactive)
+    {
+        pid_t self = getpid();
+        setpgid(self, pgid == 0 ? self : pgid);
+        if (!background)
+        {
+            tcsetpgrp(sh->shell_terminal, pgid == 0 ? self : pgid);
+        }
+    }
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    // Job reaping belongs to the parent shell
+    signal(SIGCHLD, SIG_DFL);
+}
+
+// path_lookup, counted as a use and timed for the stats built in
+static const char *lookup(struct shell *sh, const char *name)
+{
+    uint64_t start = stats_now();
+    const char *path = path_lookup(&sh->paths, name, true);
+    stats_record(&sh->stats, STAT_PATH, start, name);
+    return path;
+}
+
+// fork, timed in the parent
+static pid_t fork_child(struct shell *sh)
+{
+    uint64_t start = stats_now();
+    pid_t pid = fork();
+    if (pid > 0)
+    {
+        stats_record(&sh->stats, STAT_FORK, start, NULL);
+    }
+    return pid;
+}
+
+/*
+ * Resolve the executable of a command in the parent, so the PATH cache is
+ * filled and its hit counts kept even when the exec happens in a child.
+ * Returns NULL for built ins, empty commands and commands not found.
+ */
+static const char *resolve(struct shell *sh, struct node *cmd)
+{
+    char *name = cmd->cmd.argv[0];
+    if (name == NULL || is_builtin(name))
+    {
+        return NULL;
+    }
+    return lookup(sh, name);
+}
+
+// Runs in the child after fork; never returns
+static void exec_command(struct shell *sh, struct node *cmd, const char *path)
+{
+    char **argv = cmd->cmd.argv;
+
+    if (redirect_fds(cmd->cmd.redirs, NULL, NULL) < 0)
+    {
+        _exit(1);
+    }
+    if (argv[0] == NULL)
+    {
+        _exit(0);
+    }
+    if (do_builtin(sh, argv))
+    {
+        fflush(NULL);
+        _exit(sh->last_status);
+    }
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        _exit(127);
+    }
+
+    execv(path, argv);
+    if (errno == ENOENT && path != argv[0])
+    {
+        // The cached path went away; the parent relearns it on the spawn path
+        execvp(argv[0], argv);
+    }
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+    _exit(errno == ENOENT ? 127 : 126);
+}
+
+/*
+ * Wait until every process of a foreground job has exited (or stopped).
+ * With job control the whole process group is reaped by one loop, in
+ * whatever order the stages finish; without it the children share the
+ * shell's group, so they are waited for by pid. While background jobs run,
+ * any child is waited for instead, and the background ones that exit are
+ * handed to the job table on the spot so their end time is right. The
+ * status is the last stage's, as in sh.
+ */
+static int wait_foreground(struct shell *sh, pid_t pgid, pid_t *pids, int n)
+{
+    int status = 0;
+    uint64_t start = stats_now();
+
+    if (sh->shell_is_interactive)
+    {
+        tcsetpgrp(sh->shell_terminal, pgid);
+    }
+
+    for (int left = n; left > 0;)
+    {
+        int st = 0;
+        struct rusage ru;
+        pid_t target = jobs_live() ? -1 : sh->shell_is_interactive ? -pgid : pids[n - left];
+        pid_t pid = wait4(target, &st, WUNTRACED, &ru);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if (target == -1 && jobs_child_exited(pid, st, &ru))
+        {
+            continue;
+        }
+        if (sh->usage != NULL && !WIFSTOPPED(st))
+        {
+            usage_add(sh->usage, &ru);
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (pids[i] == pid)
+            {
+                if (i == n - 1)
+                {
+                    status = wait_status(st);
+                }
+                left--;
+                break;
+            }
+        }
+    }
+
+    if (sh->shell_is_interactive)
+    {
+        tcsetpgrp(sh->shell_terminal, getpgrp());
+    }
+    stats_record(&sh->stats, STAT_WAIT, start, NULL);
+    return status;
+}
+
+/*
+ * Fork a copy of the shell that runs an arbitrary tree, for anything after
+ * & that is not a single external command or a pipeline. Returns the pid,
+ * or -1 if fork failed.
+ */
+static pid_t fork_subshell(struct shell *sh, struct node *n)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork_child(sh);
+    if (pid == 0)
+    {
+        child_setup(sh, 0, true);
+        sh->shell_is_interactive = 0;
+        int status = execute(sh, n);
+        fflush(NULL);
+        _exit(status);
+    }
+    if (pid < 0)
+    {
+        perror("fork failed");
+        return -1;
+    }
+
+    if (sh->shell_is_interactive)
+    {
+        setpgid(pid, pid);
+    }
+    return pid;
+}
+
+/*
+ * spawn_process for a path from lookup. When the spawn fails with ENOENT
+ * the cached path may have gone away, whatever the shape of the command,
+ * so it is forgotten and PATH searched again before one more try; *path is
+ * updated to what was tried last. A missing redirection target fails the
+ * same way twice and only costs the search.
+ */
+static int spawn_cached(struct shell *sh, const char **path, char **argv, pid_t pgid, bool foreground,
+                        const struct spawn_io *io, pid_t *pid)
+{
+    int err = *path ? spawn_process(sh, *path, argv, pgid, foreground, io, pid) : ENOENT;
+    if (err == ENOENT && *path != NULL && *path != argv[0])
+    {
+        path_forget(&sh->paths, argv[0]);
+        *path = lookup(sh, argv[0]);
+        err = *path ? spawn_process(sh, *path, argv, pgid, foreground, io, pid) : ENOENT;
+    }
+    return err;
+}
+
+/*
+ * Start one pipeline stage with posix_spawn when nothing but exec has to
+ * happen in the child. Returns false if the stage needs the fork path.
+ */
+static bool spawn_stage(struct shell *sh, struct node *cmd, pid_t pgid, bool foreground,
+                        const struct spawn_io *io, pid_t *pid)
+{
+    char **argv = cmd->cmd.argv;
+    if (sh->spawn_mode == SPAWN_FORK || argv[0] == NULL || is_builtin(argv[0]))
+    {
+        return false;
+    }
+    const char *path = lookup(sh, argv[0]);
+    // Errors are left to the fork path, which reports them from the child
+    return spawn_cached(sh, &path, argv, pgid, foreground, io, pid) == 0;
+}
+
+/*
+ * Start a | b | c: every stage is started back to back into one process
+ * group with its pipes already wired, and nothing is waited for. The pids
+ * go to pids, which has room for every stage. Returns how many stages
+ * were started, which is fewer than all of them only after an error.
+ */
+static int start_pipeline(struct shell *sh, struct node *pl, bool background, pid_t *pids)
+{
+    int n = pl->pipe.n;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pgid = 0;
+    int in_fd = -1;
+    int started = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int fds[2] = {-1, -1};
+        if (i < n - 1 && pipe2(fds, O_CLOEXEC) < 0)
+        {
+            perror("pipe failed");
+            break;
+        }
+
+        struct node *stage = pl->pipe.stages[i];
+        struct spawn_io io = {.in = in_fd, .out = fds[1], .redirs = stage->cmd.redirs};
+        pid_t pid;
+        if (!spawn_stage(sh, stage, pgid, !background, &io, &pid))
+        {
+            const char *path = resolve(sh, stage);
+            pid = fork_child(sh);
+            if (pid == 0)
+            {
+                child_setup(sh, pgid, background);
+                if (in_fd >= 0)
+                {
+                    dup2(in_fd, STDIN_FILENO);
+                }
+                if (fds[1] >= 0)
+                {
+                    dup2(fds[1], STDOUT_FILENO);
+                }
+                exec_command(sh, stage, path);
+            }
+            if (pid < 0)
+            {
+                perror("fork failed");
+                close(fds[0]);
+                close(fds[1]);
+                break;
+            }
+            if (sh->shell_is_interactive)
+            {
+                setpgid(pid, pgid == 0 ? pid : pgid);
+            }
+        }
+
+        if (pgid == 0)
+        {
+            pgid = pid;
+        }
+        pids[started++] = pid;
+
+        if (in_fd >= 0)
+        {
+            close(in_fd);
+        }
+        if (fds[1] >= 0)
+        {
+            close(fds[1]);
+        }
+        in_fd = fds[0];
+    }
+    if (in_fd >= 0)
+    {
+        close(in_fd);
+    }
+    return started;
+}
+
+// A pipeline in the foreground: start every stage, then wait for them all
+static int run_pipeline(struct shell *sh, struct node *pl)
+{
+    int n = pl->pipe.n;
+    pid_t *pids = arena_alloc(&sh->mem, sizeof(pid_t) * (size_t)n);
+    if (pids == NULL)
+    {
+        return 1;
+    }
+
+    int started = start_pipeline(sh, pl, false, pids);
+    int status = 1;
+    if (started > 0)
+    {
+        int last = wait_foreground(sh, pids[0], pids, started);
+        status = started == n ? last : 1;
+    }
+    return status;
+}
+
+/*
+ * Start a simple external command without waiting for it. Returns 0 with
+ * the child in *pid, or the exit status of a command that could not be
+ * started.
+ */
+static int start_command(struct shell *sh, struct node *cmd, bool background, pid_t *pid)
+{
+    bool spawned = false;
+    struct redir *redirs = cmd->cmd.redirs;
+    if (sh->spawn_mode != SPAWN_FORK && !is_builtin(cmd->cmd.argv[0]))
+    {
+        // Fast path: redirections become file actions, so nothing runs in
+        // the child but exec itself
+        char **argv = cmd->cmd.argv;
+        struct spawn_io io = {.in = -1, .out = -1, .redirs = redirs};
+        const char *path = lookup(sh, argv[0]);
+        // Keep our buffered output ahead of the child's when stdout is a pipe
+        fflush(stdout);
+        int err = spawn_cached(sh, &path, argv, 0, !background, &io, pid);
+        spawned = err == 0;
+        if (!spawned && redirs == NULL)
+        {
+            if (path == NULL)
+            {
+                fprintf(stderr, "%s: command not found\n", argv[0]);
+                return 127;
+            }
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+            return err == ENOENT ? 127 : 126;
+        }
+        // A failed redirection can't be told apart from a failed exec here;
+        // the fork path redoes the command and reports exactly what failed
+    }
+    if (!spawned)
+    {
+        const char *path = resolve(sh, cmd);
+        fflush(stdout);
+        fflush(stderr);
+
+        *pid = fork_child(sh);
+        if (*pid == 0)
+        {
+            child_setup(sh, 0, background);
+            exec_command(sh, cmd, path);
+        }
+        if (*pid < 0)
+        {
+            perror("fork failed");
+            return 1;
+        }
+
+        if (sh->shell_is_interactive)
+        {
+            setpgid(*pid, *pid);
+        }
+    }
+    return 0;
+}
+
+int start_background(struct shell *sh, struct node *n, pid_t **pids, int *count)
+{
+    int cap = n->type == NODE_PIPELINE ? n->pipe.n : 1;
+    int status = 0;
+    *count = 0;
+    *pids = arena_alloc(&sh->mem, sizeof(pid_t) * (size_t)cap);
+    if (*pids == NULL)
+    {
+        return 1;
+    }
+
+    if (n->type == NODE_PIPELINE)
+    {
+        *count = start_pipeline(sh, n, true, *pids);
+        status = *count == cap ? 0 : 1;
+    }
+    else if (n->type == NODE_COMMAND && n->cmd.argv[0] != NULL && !is_builtin(n->cmd.argv[0]))
+    {
+        status = start_command(sh, n, true, *pids);
+        *count = status == 0;
+    }
+    else
+    {
+        (*pids)[0] = fork_subshell(sh, n);
+        *count = (*pids)[0] > 0;
+        status = *count ? 0 : 1;
+    }
+
+    return status;
+}
+
+int create_process(struct node *cmd, struct shell *sh, bool background)
+{
+    if (background)
+    {
+        return submit_job(sh, cmd);
+    }
+    if (cmd->type == NODE_PIPELINE)
+    {
+        return run_pipeline(sh, cmd);
+    }
+
+    pid_t pid;
+    int status = start_command(sh, cmd, false, &pid);
+    if (status != 0)
+    {
+        return status;
+    }
+    return wait_foreground(sh, pid, &pid, 1);
+}
+
+// A simple command in the foreground: built ins run in the shell itself
+static int run_simple(struct shell *sh, struct node *cmd)
+{
+    char **argv = cmd->cmd.argv;
+    struct redir *redirs = cmd->cmd.redirs;
+
+    if (argv[0] != NULL && !is_builtin(argv[0]))
+    {
+        return create_process(cmd, sh, false);
+    }
+    if (redirs == NULL)
+    {
+        do_builtin(sh, argv);
+        return argv[0] == NULL ? 0 : sh->last_status;
+    }
+
+    int n_saved = 0;
+    struct saved_fd saved[count_redirs(redirs)];
+    fflush(stdout);
+    fflush(stderr);
+
+    int status = 1;
+    if (redirect_fds(redirs, saved, &n_saved) == 0)
+    {
+        status = 0;
+        if (argv[0] != NULL)
+        {
+            do_builtin(sh, argv);
+            status = sh->last_status;
+        }
+    }
+    restore_fds(saved, n_saved);
+    return status;
+}
+
+/*
+ * time pipeline: runs it right here, with no process of its own, and adds
+ * up what wait4 reports for each foreground child plus what the shell
+ * itself spent, which is all a built in costs.
+ */
+static int run_timed(struct shell *sh, struct node *n)
+{
+    struct rusage used = {0};
+    struct rusage before, after;
+    struct rusage *outer = sh->usage;
+
+    sh->usage = &used;
+    getrusage(RUSAGE_SELF, &before);
+    uint64_t start = stats_now();
+    int status = n != NULL ? execute(sh, n) : 0;
+    uint64_t real = stats_now() - start;
+    getrusage(RUSAGE_SELF, &after);
+    sh->usage = outer;
+
+    if (used.ru_maxrss == 0)
+    {
+        // Nothing was waited for: it all ran in the shell
+        used.ru_maxrss = after.ru_maxrss;
+    }
+    usage_add_delta(&used, &after, &before);
+    if (outer != NULL)
+    {
+        usage_add(outer, &used);
+    }
+    fflush(stdout);
+    usage_print(stderr, real, &used);
+    return status;
+}
+
+int execute(struct shell *sh, struct node *n)
+{
+    int status = 0;
+
+    switch (n->type)
+    {
+    case NODE_COMMAND:
+        status = run_simple(sh, n);
+        break;
+    case NODE_PIPELINE:
+        status = create_process(n, sh, false);
+        break;
+    case NODE_AND:
+        status = execute(sh, n->pair.left);
+        if (status == 0)
+        {
+            status = execute(sh, n->pair.right);
+        }
+        break;
+    case NODE_OR:
+        status = execute(sh, n->pair.left);
+        if (status != 0)
+        {
+            status = execute(sh, n->pair.right);
+        }
+        break;
+    case NODE_SEQUENCE:
+        execute(sh, n->pair.left);
+        status = execute(sh, n->pair.right);
+        break;
+    case NODE_BACKGROUND:
+        status = submit_job(sh, n->child);
+        break;
+    case NODE_TIME:
+        status = run_timed(sh, n->child);
+        break;
+    }
+
+    sh->last_status = status;
+    return status;
+}
+
+int execute_last(struct shell *sh, struct node *n)
+{
+    if (n->type == NODE_SEQUENCE)
+    {
+        execute(sh, n->pair.left);
+        return execute_last(sh, n->pair.right);
+    }
+    // Queued background jobs still need the shell to start them, and a
+    // running trace has to be finished by sh_destroy
+    if (n->type != NODE_COMMAND || n->cmd.argv[0] == NULL || is_builtin(n->cmd.argv[0]) ||
+        jobs_pending() > 0 || trace_file() != NULL)
+    {
+        return execute(sh, n);
+    }
+
+    // Nothing runs after this command, so it can take over the process
+    fflush(stdout);
+    fflush(stderr);
+    exec_command(sh, n, resolve(sh, n));
+    return 127;
+}
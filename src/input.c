@@ -0,0 +1,141 @@
+#include "input.h"
+#include "parse.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define READER_BLOCK (64 * 1024)
+
+void reader_init(struct line_reader *r, int fd)
+{
+    r->fd = fd;
+    r->buf = NULL;
+    r->cap = 0;
+    r->start = 0;
+    r->end = 0;
+    r->line = 0;
+    r->newline = false;
+    r->eof = false;
+}
+
+// Make room for at least one more block after the unread bytes
+static bool make_room(struct line_reader *r)
+{
+    if (r->start > 0)
+    {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    // One byte stays free for the terminator of a final unterminated line
+    if (r->cap - r->end > 1)
+    {
+        return true;
+    }
+
+    size_t cap = r->cap ? r->cap * 2 : READER_BLOCK;
+    char *buf = realloc(r->buf, cap);
+    if (buf == NULL)
+    {
+        perror("realloc failed");
+        return false;
+    }
+    r->buf = buf;
+    r->cap = cap;
+    return true;
+}
+
+// The line from r->start to the next newline, of which scanned is known to hold none
+static char *read_line(struct line_reader *r, size_t scanned, size_t *len)
+{
+    for (;;)
+    {
+        char *nl = r->end > scanned ? memchr(r->buf + scanned, '\n', r->end - scanned) : NULL;
+        if (nl != NULL)
+        {
+            char *line = r->buf + r->start;
+            *nl = '\0';
+            if (len != NULL)
+            {
+                *len = (size_t)(nl - line);
+            }
+            r->line = r->start;
+            r->newline = true;
+            r->start = (size_t)(nl - r->buf) + 1;
+            return line;
+        }
+
+        if (r->eof)
+        {
+            if (r->start == r->end)
+            {
+                return NULL;
+            }
+            char *line = r->buf + r->start;
+            r->buf[r->end] = '\0';
+            if (len != NULL)
+            {
+                *len = r->end - r->start;
+            }
+            r->line = r->start;
+            r->newline = false;
+            r->start = r->end;
+            return line;
+        }
+
+        // Only the bytes that arrive now still need to be searched
+        scanned = r->end - r->start;
+        if (!make_room(r))
+        {
+            return NULL;
+        }
+
+        ssize_t n = read(r->fd, r->buf + r->end, r->cap - r->end - 1);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            r->eof = true;
+        }
+        else
+        {
+            r->end += (size_t)n;
+        }
+    }
+}
+
+char *reader_line(struct line_reader *r, size_t *len)
+{
+    return read_line(r, r->start, len);
+}
+
+char *reader_command(struct line_reader *r, size_t *len)
+{
+    size_t n;
+    char *line = read_line(r, r->start, &n);
+    while (line != NULL && r->newline && parse_incomplete(line))
+    {
+        // Put the newline back and read on to the one after it
+        size_t scanned = r->start;
+        r->buf[scanned - 1] = '\n';
+        r->start = r->line;
+        line = read_line(r, scanned, &n);
+    }
+    if (line != NULL && len != NULL)
+    {
+        *len = n;
+    }
+    return line;
+}
+
+void reader_destroy(struct line_reader *r)
+{
+    free(r->buf);
+    r->buf = NULL;
+    r->cap = 0;
+    r->start = r->end = 0;
+}
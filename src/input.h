@@ -0,0 +1,74 @@
+#ifndef INPUT_H
+#define INPUT_H
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Reads lines from a descriptor in large blocks and splits them with
+     * memchr. Used in place of readline when the input is not a terminal,
+     * where readline's per-character terminal handling and history buy
+     * nothing. Like dash, the shell owns every byte it has read, so a
+     * command run from a piped script sees stdin past the buffered block.
+     */
+    struct line_reader
+    {
+        int fd;
+        char *buf;
+        size_t cap;
+        size_t start; // first byte not returned yet
+        size_t end; // end of the bytes read so far
+        size_t line; // start of the last line returned
+        bool newline; // whether that line ended with a newline
+        bool eof;
+    };
+
+    /**
+     * @brief Initialize a reader on fd. No memory is allocated until the
+     * first call to reader_line.
+     *
+     * @param r The reader
+     * @param fd The descriptor to read from
+     */
+    void reader_init(struct line_reader *r, int fd);
+
+    /**
+     * @brief Return the next line without its newline. A last line with
+     * no newline is returned as well. The line lives in the reader's
+     * buffer and may be modified; it is valid until the next call.
+     *
+     * @param r The reader
+     * @param len Set to the length of the line if not NULL
+     * @return The line, or NULL at end of input or on a read error
+     */
+    char *reader_line(struct line_reader *r, size_t *len);
+
+    /**
+     * @brief Return the next command: the next line, joined with the lines
+     * after it, newlines included, for as long as parse_incomplete says an
+     * open quote or a trailing backslash continues it. Input that ends
+     * inside a quote is returned as it is, for the parser to report. The
+     * command lives in the reader's buffer like a line from reader_line.
+     *
+     * @param r The reader
+     * @param len Set to the length of the command if not NULL
+     * @return The command, or NULL at end of input or on a read error
+     */
+    char *reader_command(struct line_reader *r, size_t *len);
+
+    /**
+     * @brief Free the buffer. The descriptor is left open.
+     *
+     * @param r The reader
+     */
+    void reader_destroy(struct line_reader *r);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
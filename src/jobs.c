@@ -0,0 +1,1200 @@
+#define _GNU_SOURCE
+#include "lab.h"
+#include "pool.h"
+#include "trace.h"
+#include "usage.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+// Older headers know pidfd_open but not the waitid id type
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+/*
+ * Background jobs live in a table that grows by doubling. A job's slot is
+ * recycled through a free list once its Done line has been printed, job
+ * ids are the lowest free ones (a bitmap, like a shell's %n numbering),
+ * and a pid -> (slot, stage) hash index makes lookups O(1). The storage is
+ * released whenever the table empties, so memory follows the live jobs.
+ *
+ * A job keeps its whole command line as text. The text, the stage arrays
+ * and the records of queued jobs come from a pool with per-size free
+ * lists, so recycled slots reuse the same blocks and launching millions of
+ * jobs does not grow memory or call malloc; the pool goes away with the
+ * rest of the storage.
+ *
+ * With a maxjobs limit, a job submitted while the limit is reached gets
+ * its slot and id right away but waits on a FIFO as Pending, holding a
+ * copy of its syntax tree, until a running job is reaped.
+ */
+#define JOB_TABLE_MIN 16
+// The exit status of a job whose real status could not be collected
+#define JOB_STATUS_LOST 127
+// Enough for the tree of a typical queued command in one chunk
+#define PENDING_CHUNK 512
+
+struct pending_job
+{
+    struct shell *sh;
+    struct node *tree;
+    struct arena mem;
+};
+
+struct pid_entry
+{
+    pid_t pid; // 0 is empty
+    int slot;
+    int stage;
+};
+
+// A process that has no pidfd, e.g. because the shell ran out of descriptors
+struct unwatched
+{
+    int slot;
+    int stage;
+};
+
+static struct
+{
+    struct job *slots;
+    int cap;
+    int used; // slots handed out at least once
+    int count; // jobs in the table, running or not reported yet
+    int free_head; // free list through job.next
+    int done_head; // finished jobs waiting for check_jobs, oldest first
+    int done_tail;
+    int pending_head; // jobs queued under maxjobs, oldest first
+    int pending_tail;
+    int collect_head; // finished task jobs waiting for jobs_collect
+    int collect_tail;
+    int n_pending;
+    int running; // jobs started and not finished
+    uint64_t *ids; // bit n set when job id n + 1 is taken
+    int id_hint; // no free id below this word
+    struct pid_entry *index; // linear probing, at most half full
+    size_t index_cap;
+    size_t index_count;
+    struct unwatched *unwatched;
+    int n_unwatched;
+    int unwatched_cap;
+    struct pool mem; // command text, stages and pending jobs
+} table = {.free_head = -1, .done_head = -1, .done_tail = -1, .pending_head = -1, .pending_tail = -1,
+           .collect_head = -1, .collect_tail = -1};
+
+// Survives table_free, which happens whenever the table empties
+static int max_running = 0;
+
+// The jobs that finished last, for jobs -l. Kept apart from the table so
+// they survive table_free, with their text in a pool of their own.
+#define JOBS_FINISHED 16
+
+struct finished_job
+{
+    int job_id;
+    pid_t pid;
+    int status;
+    char *command;
+    uint64_t real_ns;
+    struct rusage usage;
+};
+
+static struct
+{
+    struct finished_job jobs[JOBS_FINISHED];
+    int count;
+    int next; // where the next one goes, the oldest once the ring is full
+    struct pool mem;
+} finished;
+
+/*
+ * Every background process holds a pidfd registered in one epoll instance,
+ * so the input loop waits on stdin and on all jobs together and a finished
+ * process is reaped through its own descriptor, with no race against pid
+ * reuse. The epoll data of a pidfd is the slot + 1 in the low half and the
+ * pipeline stage in the high half; for a child the table had no room for
+ * the low half is 0 and the high half is the descriptor.
+ *
+ * Without pidfd_open (kernels before 5.3, or MY_JOB_EVENTS=sigchld) the
+ * SIGCHLD handler raises a flag and writes a byte to a self-pipe that sits
+ * in the same epoll set, and jobs_reap drains waitpid(-1). Either way the
+ * work done is proportional to the number of children that exited.
+ *
+ * The descriptor limit is left as it is, since every command the shell
+ * runs would inherit a raised one. A process that gets no pidfd (EMFILE)
+ * is reaped the SIGCHLD way instead: the pipe joins the epoll set up front,
+ * when descriptors are still there, the handler is installed at the first
+ * such process, and those processes are polled with wait4 only after a
+ * SIGCHLD, so the children that do have a pidfd are never taken from it.
+ */
+static int job_epoll = -1;
+static pid_t job_owner = 0; // the process that set all this up
+static bool use_pidfd = false;
+static int n_live = 0;
+static volatile sig_atomic_t sigchld_seen = 0;
+static bool sigchld_handled = false; // the handler is installed
+static int sigchld_pipe[2] = {-1, -1};
+// The epoll tag of the SIGCHLD pipe, which no pidfd tag can equal
+#define SIGCHLD_TAG UINT64_MAX
+
+static size_t pid_hash(pid_t pid, size_t cap)
+{
+    return ((uint32_t)pid * 2654435761u) & (cap - 1);
+}
+
+static void index_put(struct pid_entry *index, size_t cap, struct pid_entry e)
+{
+    size_t i = pid_hash(e.pid, cap);
+    while (index[i].pid != 0)
+        i = (i + 1) & (cap - 1);
+    index[i] = e;
+}
+
+static bool index_insert(pid_t pid, int slot, int stage)
+{
+    if ((table.index_count + 1) * 2 > table.index_cap)
+    {
+        size_t cap = table.index_cap ? table.index_cap * 2 : JOB_TABLE_MIN * 2;
+        struct pid_entry *index = calloc(cap, sizeof(struct pid_entry));
+        if (index == NULL)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < table.index_cap; i++)
+        {
+            if (table.index[i].pid != 0)
+            {
+                index_put(index, cap, table.index[i]);
+            }
+        }
+        free(table.index);
+        table.index = index;
+        table.index_cap = cap;
+    }
+    index_put(table.index, table.index_cap, (struct pid_entry){pid, slot, stage});
+    table.index_count++;
+    return true;
+}
+
+static size_t index_find(pid_t pid)
+{
+    if (table.index_cap == 0)
+    {
+        return 0;
+    }
+    for (size_t i = pid_hash(pid, table.index_cap); table.index[i].pid != 0; i = (i + 1) & (table.index_cap - 1))
+    {
+        if (table.index[i].pid == pid)
+        {
+            return i;
+        }
+    }
+    return table.index_cap;
+}
+
+static void index_remove(size_t hole)
+{
+    const size_t mask = table.index_cap - 1;
+    table.index[hole].pid = 0;
+    table.index_count--;
+    // Backward shift deletion keeps every probe sequence unbroken
+    for (size_t i = (hole + 1) & mask; table.index[i].pid != 0; i = (i + 1) & mask)
+    {
+        size_t home = pid_hash(table.index[i].pid, table.index_cap);
+        bool movable = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+        if (movable)
+        {
+            table.index[hole] = table.index[i];
+            table.index[i].pid = 0;
+            hole = i;
+        }
+    }
+}
+
+// Double the table and the id bitmap with it
+static bool table_grow(void)
+{
+    int cap = table.cap ? table.cap * 2 : JOB_TABLE_MIN;
+    struct job *slots = realloc(table.slots, cap * sizeof(struct job));
+    if (slots == NULL)
+    {
+        return false;
+    }
+    table.slots = slots;
+
+    size_t old_words = table.cap ? (size_t)table.cap / 64 + 1 : 0;
+    size_t words = (size_t)cap / 64 + 1;
+    uint64_t *ids = realloc(table.ids, words * sizeof(uint64_t));
+    if (ids == NULL)
+    {
+        return false;
+    }
+    memset(ids + old_words, 0, (words - old_words) * sizeof(uint64_t));
+    table.ids = ids;
+    table.cap = cap;
+    return true;
+}
+
+static bool add_unwatched(int slot, int stage)
+{
+    if (table.n_unwatched == table.unwatched_cap)
+    {
+        int cap = table.unwatched_cap ? table.unwatched_cap * 2 : JOB_TABLE_MIN;
+        struct unwatched *u = realloc(table.unwatched, cap * sizeof(struct unwatched));
+        if (u == NULL)
+        {
+            return false;
+        }
+        table.unwatched = u;
+        table.unwatched_cap = cap;
+    }
+    table.unwatched[table.n_unwatched++] = (struct unwatched){slot, stage};
+    return true;
+}
+
+static int alloc_id(void)
+{
+    int w = table.id_hint;
+    while (table.ids[w] == UINT64_MAX)
+    {
+        w++;
+    }
+    int bit = __builtin_ctzll(~table.ids[w]);
+    table.ids[w] |= 1ull << bit;
+    table.id_hint = w;
+    return w * 64 + bit + 1;
+}
+
+static void free_id(int id)
+{
+    int w = (id - 1) / 64;
+    table.ids[w] &= ~(1ull << ((id - 1) % 64));
+    if (w < table.id_hint)
+    {
+        table.id_hint = w;
+    }
+}
+
+// A zeroed slot: one fresh from table_grow holds whatever realloc left there
+static int alloc_slot(void)
+{
+    int slot;
+    if (table.free_head >= 0)
+    {
+        slot = table.free_head;
+        table.free_head = table.slots[slot].next;
+    }
+    else if (table.used < table.cap || table_grow())
+    {
+        slot = table.used++;
+    }
+    else
+    {
+        return -1;
+    }
+    memset(&table.slots[slot], 0, sizeof(table.slots[slot]));
+    return slot;
+}
+
+static void table_free(void)
+{
+    free(table.slots);
+    free(table.ids);
+    free(table.index);
+    free(table.unwatched);
+    pool_destroy(&table.mem);
+    memset(&table, 0, sizeof(table));
+    table.free_head = table.done_head = table.done_tail = -1;
+    table.pending_head = table.pending_tail = -1;
+    table.collect_head = table.collect_tail = -1;
+}
+
+static void free_pending(struct pending_job *p)
+{
+    if (p != NULL)
+    {
+        arena_destroy(&p->mem);
+        pool_free(&table.mem, p, sizeof(*p));
+    }
+}
+
+// The text of a command for the job listing, in the pool
+static char *job_text(const struct node *cmd)
+{
+    size_t len = node_format(cmd, NULL, 0);
+    char *text = pool_alloc(&table.mem, len + 1);
+    if (text != NULL)
+    {
+        node_format(cmd, text, len + 1);
+    }
+    return text;
+}
+
+static struct job_stage *alloc_stages(int n)
+{
+    struct job_stage *stages = pool_alloc(&table.mem, sizeof(struct job_stage) * (size_t)n);
+    if (stages != NULL)
+    {
+        memset(stages, 0, sizeof(struct job_stage) * (size_t)n);
+    }
+    return stages;
+}
+
+// Give back what a job record holds in the pool
+static void free_record(struct job *j)
+{
+    free_pending(j->pending);
+    if (j->command != NULL)
+    {
+        pool_free(&table.mem, j->command, strlen(j->command) + 1);
+    }
+    pool_free(&table.mem, j->stages, sizeof(struct job_stage) * (size_t)j->n_stages);
+    j->pending = NULL;
+    j->command = NULL;
+    j->stages = NULL;
+}
+
+static void release_slot(int slot)
+{
+    struct job *j = &table.slots[slot];
+    free_record(j);
+    free_id(j->job_id);
+    j->job_id = 0;
+    j->next = table.free_head;
+    table.free_head = slot;
+
+    // Nothing left to track: give the memory back
+    if (--table.count == 0 && table.cap > JOB_TABLE_MIN)
+    {
+        table_free();
+    }
+}
+
+struct job *job_find(pid_t pid)
+{
+    size_t at = index_find(pid);
+    return at < table.index_cap ? &table.slots[table.index[at].slot] : NULL;
+}
+
+static void on_sigchld(int sig)
+{
+    UNUSED(sig);
+    int saved = errno;
+    sigchld_seen = 1;
+    if (sigchld_pipe[1] >= 0)
+    {
+        // Non-blocking: a full pipe already guarantees a wake up
+        ssize_t n = write(sigchld_pipe[1], "", 1);
+        UNUSED(n);
+    }
+    errno = saved;
+}
+
+static int pidfd_open(pid_t pid)
+{
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+static void unwatch_fd(int fd)
+{
+    // A child being spawned may still hold a copy of the pidfd, so closing
+    // it alone would leave the registration behind
+    epoll_ctl(job_epoll, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+}
+
+static void open_sigchld_pipe(void)
+{
+    if (pipe2(sigchld_pipe, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        perror("pipe failed");
+        sigchld_pipe[0] = sigchld_pipe[1] = -1;
+    }
+    else if (job_epoll >= 0)
+    {
+        struct epoll_event ev = {.events = EPOLLIN, .data.u64 = SIGCHLD_TAG};
+        epoll_ctl(job_epoll, EPOLL_CTL_ADD, sigchld_pipe[0], &ev);
+    }
+}
+
+static void init_sigchld(void)
+{
+    if (sigchld_pipe[0] < 0)
+    {
+        open_sigchld_pipe();
+    }
+    sigchld_handled = true;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+    // The first job may have exited before the handler was installed
+    sigchld_seen = 1;
+}
+
+// Release every job record; unwatch is false when the epoll set is not ours
+static void free_jobs(bool unwatch)
+{
+    for (int i = 0; i < table.used; i++)
+    {
+        struct job *j = &table.slots[i];
+        for (int k = 0; j->job_id != 0 && k < j->n_stages; k++)
+        {
+            if (j->stages[k].pidfd >= 0 && unwatch)
+            {
+                unwatch_fd(j->stages[k].pidfd);
+            }
+            else if (j->stages[k].pidfd >= 0)
+            {
+                close(j->stages[k].pidfd);
+            }
+        }
+        if (j->job_id != 0 && j->pending != NULL)
+        {
+            // The rest goes with the pool
+            arena_destroy(&j->pending->mem);
+        }
+    }
+    table_free();
+    n_live = 0;
+    pool_destroy(&finished.mem);
+    memset(&finished, 0, sizeof(finished));
+}
+
+/*
+ * A forked child of the shell that runs jobs of its own (parallel in a
+ * pipeline) inherits the parent's table, but the epoll set and the SIGCHLD
+ * pipe are shared with the parent across fork. Drop all of it without
+ * touching the registrations, which EPOLL_CTL_DEL would remove for the
+ * parent as well.
+ */
+static void drop_inherited(void)
+{
+    free_jobs(false);
+    if (job_epoll >= 0)
+    {
+        close(job_epoll);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (sigchld_pipe[i] >= 0)
+        {
+            close(sigchld_pipe[i]);
+        }
+        sigchld_pipe[i] = -1;
+    }
+    job_epoll = -1;
+    use_pidfd = false;
+    sigchld_seen = 0;
+}
+
+void jobs_init(void)
+{
+    if ((job_epoll >= 0 || sigchld_pipe[0] >= 0) && job_owner != getpid())
+    {
+        drop_inherited();
+    }
+    if (job_epoll >= 0 || sigchld_pipe[0] >= 0)
+    {
+        return;
+    }
+    job_owner = getpid();
+
+    job_epoll = epoll_create1(EPOLL_CLOEXEC);
+    const char *events = getenv("MY_JOB_EVENTS");
+    bool want_pidfd = job_epoll >= 0 && (events == NULL || strcmp(events, "sigchld") != 0);
+
+    int probe = want_pidfd ? pidfd_open(getpid()) : -1;
+    if (probe < 0)
+    {
+        init_sigchld();
+        return;
+    }
+    close(probe);
+    use_pidfd = true;
+    // Opened now, while there are descriptors, for processes that get no pidfd
+    open_sigchld_pipe();
+}
+
+int jobs_event_fd(void)
+{
+    jobs_init();
+    return job_epoll >= 0 ? job_epoll : sigchld_pipe[0];
+}
+
+// Register a pidfd for pid under the given epoll tag, -1 if that failed
+static int watch_pid(pid_t pid, int slot, int stage)
+{
+    int fd = pidfd_open(pid);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    uint32_t high = slot >= 0 ? (uint32_t)stage : (uint32_t)fd;
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (uint64_t)high << 32 | (uint32_t)(slot + 1)};
+    if (epoll_ctl(job_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Put back a slot that never got a job
+static void unalloc_slot(int slot)
+{
+    // list_jobs and free_jobs take any slot with a job id for a live job
+    table.slots[slot].job_id = 0;
+    table.slots[slot].next = table.free_head;
+    table.free_head = slot;
+}
+
+// Out of memory: not listed, but the children must still be reaped
+static void watch_orphans(const pid_t *pids, int n)
+{
+    // The SIGCHLD fallback does that anyway through waitpid(-1)
+    for (int i = 0; use_pidfd && i < n; i++)
+    {
+        if (watch_pid(pids[i], -1, 0) >= 0)
+        {
+            n_live++;
+        }
+    }
+}
+
+// Make the job in slot a running one made of the given processes
+static void attach_stages(int slot, const pid_t *pids, int n, struct job_stage *stages)
+{
+    struct job *j = &table.slots[slot];
+    j->pid = pids[0];
+    j->status = 0;
+    j->active = 1;
+    j->n_stages = n;
+    j->n_running = n;
+    j->stages = stages;
+    j->next = -1;
+    memset(&j->usage, 0, sizeof(j->usage));
+    j->started = stats_now();
+    j->ended = 0;
+    if (!j->quiet)
+    {
+        table.running++;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        stages[i].pid = pids[i];
+        stages[i].pidfd = -1;
+        index_insert(pids[i], slot, i);
+        if (use_pidfd && (stages[i].pidfd = watch_pid(pids[i], slot, i)) < 0)
+        {
+            add_unwatched(slot, i);
+            if (!sigchld_handled)
+            {
+                // Out of descriptors: this one is left to SIGCHLD
+                init_sigchld();
+            }
+        }
+        n_live++;
+    }
+    trace_job_begin(j->pid, j->command);
+}
+
+// Record running processes as a new job; returns its slot or -1. Quiet
+// jobs are never listed, so they keep no text (cmd is NULL).
+static int record_job(const pid_t *pids, int n, const struct node *cmd, bool quiet)
+{
+    // Shells that never start a job never pay for the event set
+    jobs_init();
+
+    int slot = alloc_slot();
+    struct job_stage *stages = slot >= 0 ? alloc_stages(n) : NULL;
+    char *text = stages != NULL && cmd != NULL ? job_text(cmd) : NULL;
+    if (stages == NULL || (cmd != NULL && text == NULL))
+    {
+        if (slot >= 0)
+        {
+            pool_free(&table.mem, stages, sizeof(struct job_stage) * (size_t)n);
+            unalloc_slot(slot);
+        }
+        watch_orphans(pids, n);
+        return -1;
+    }
+
+    struct job *j = &table.slots[slot];
+    j->job_id = alloc_id();
+    j->command = text;
+    j->pending = NULL;
+    j->quiet = quiet;
+    table.count++;
+    attach_stages(slot, pids, n, stages);
+    return slot;
+}
+
+static void print_running(const struct job *j)
+{
+    printf("[%d] %d Running %s &\n", j->job_id, j->pid, j->command);
+}
+
+int add_pipeline_job(const pid_t *pids, int n, char **argv)
+{
+    struct node cmd = {.type = NODE_COMMAND};
+    cmd.cmd.argv = argv;
+    while (argv[cmd.cmd.argc] != NULL)
+    {
+        cmd.cmd.argc++;
+    }
+
+    int slot = record_job(pids, n, &cmd, false);
+    if (slot < 0)
+    {
+        return -1;
+    }
+    print_running(&table.slots[slot]);
+    return 0;
+}
+
+int add_task_job(pid_t pid, char **argv)
+{
+    (void)argv;
+    return record_job(&pid, 1, NULL, true) < 0 ? -1 : 0;
+}
+
+pid_t jobs_collect(int *status)
+{
+    if (table.collect_head < 0)
+    {
+        return 0;
+    }
+    int slot = table.collect_head;
+    struct job *j = &table.slots[slot];
+    table.collect_head = j->next;
+    if (table.collect_head < 0)
+    {
+        table.collect_tail = -1;
+    }
+    pid_t pid = j->pid;
+    *status = j->stages[j->n_stages - 1].status;
+    release_slot(slot);
+    return pid;
+}
+
+int add_job(pid_t pid, char **argv)
+{
+    return add_pipeline_job(&pid, 1, argv);
+}
+
+// Mark a job finished and queue it for check_jobs, or jobs_collect, to report
+static void queue_done(int slot)
+{
+    struct job *j = &table.slots[slot];
+    int *head = j->quiet ? &table.collect_head : &table.done_head;
+    int *tail = j->quiet ? &table.collect_tail : &table.done_tail;
+    j->active = 0;
+    j->status = 1;
+    j->next = -1;
+    if (*tail >= 0)
+    {
+        table.slots[*tail].next = slot;
+    }
+    else
+    {
+        *head = slot;
+    }
+    *tail = slot;
+}
+
+/*
+ * Record the exit of one process of a job. Returns 1 when that was the
+ * last one, and queues the job for check_jobs.
+ */
+static int stage_done(int slot, int stage, int status, const struct rusage *ru)
+{
+    struct job *j = &table.slots[slot];
+    struct job_stage *st = &j->stages[stage];
+    usage_add(&j->usage, ru);
+    size_t at = index_find(st->pid);
+    if (at < table.index_cap)
+    {
+        index_remove(at);
+    }
+    st->pidfd = -1;
+    st->status = status;
+    st->done = true;
+    n_live--;
+    if (--j->n_running > 0)
+    {
+        return 0;
+    }
+
+    if (!j->quiet)
+    {
+        table.running--;
+    }
+    j->ended = stats_now();
+    trace_job_end(j->pid, j->stages[j->n_stages - 1].status);
+    queue_done(slot);
+    return 1;
+}
+
+// The shell's $? for a child that ended as described by waitid
+static int info_status(const siginfo_t *info)
+{
+    return info->si_code == CLD_EXITED ? info->si_status : 128 + info->si_status;
+}
+
+static void drain_sigchld_pipe(void)
+{
+    char buf[64];
+    while (sigchld_pipe[0] >= 0 && read(sigchld_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+static int reap_pidfds(void)
+{
+    struct epoll_event ev[64];
+    int reaped = 0;
+    int n;
+
+    do
+    {
+        n = epoll_wait(job_epoll, ev, 64, 0);
+        for (int i = 0; i < n; i++)
+        {
+            if (ev[i].data.u64 == SIGCHLD_TAG)
+            {
+                drain_sigchld_pipe();
+                continue;
+            }
+            int slot = (int)(uint32_t)ev[i].data.u64 - 1;
+            int high = (int)(ev[i].data.u64 >> 32);
+            if (slot < 0)
+            {
+                waitid(P_PIDFD, (id_t)high, &(siginfo_t){0}, WEXITED | WNOHANG);
+                unwatch_fd(high);
+                n_live--;
+                continue;
+            }
+
+            struct job_stage *st = &table.slots[slot].stages[high];
+            siginfo_t info = {0};
+            struct rusage ru = {0};
+            int status = 0;
+            // The raw system call, unlike glibc's waitid, also fills in rusage
+            if (syscall(SYS_waitid, P_PIDFD, (id_t)st->pidfd, &info, WEXITED | WNOHANG, &ru) == 0)
+            {
+                status = info_status(&info);
+            }
+            else
+            {
+                // EINVAL: pidfd_open came in 5.3 but P_PIDFD only in 5.4
+                int wst = 0;
+                if (wait4(st->pid, &wst, WNOHANG, &ru) > 0)
+                {
+                    status = WIFEXITED(wst) ? WEXITSTATUS(wst) : 128 + WTERMSIG(wst);
+                }
+                else
+                {
+                    // Reaped behind our back (ECHILD): the status is lost,
+                    // which must not pass for success
+                    status = JOB_STATUS_LOST;
+                    memset(&ru, 0, sizeof(ru));
+                }
+            }
+            unwatch_fd(st->pidfd);
+            reaped += stage_done(slot, high, status, &ru);
+        }
+    } while (n == 64);
+
+    // Processes without a pidfd can only have exited after a SIGCHLD
+    if (!sigchld_seen)
+    {
+        return reaped;
+    }
+    sigchld_seen = 0;
+    for (int i = 0; i < table.n_unwatched; i++)
+    {
+        struct unwatched u = table.unwatched[i];
+        int wst = 0;
+        struct rusage ru = {0};
+        pid_t got = wait4(table.slots[u.slot].stages[u.stage].pid, &wst, WNOHANG, &ru);
+        if (got != 0)
+        {
+            int status = got < 0 ? JOB_STATUS_LOST : WIFEXITED(wst) ? WEXITSTATUS(wst) : 128 + WTERMSIG(wst);
+            table.unwatched[i--] = table.unwatched[--table.n_unwatched];
+            reaped += stage_done(u.slot, u.stage, status, &ru);
+        }
+    }
+    return reaped;
+}
+
+static int reap_sigchld(void)
+{
+    int reaped = 0;
+
+    if (!sigchld_seen)
+    {
+        return 0;
+    }
+    sigchld_seen = 0;
+    drain_sigchld_pipe();
+
+    int status;
+    pid_t pid;
+    struct rusage ru;
+    while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0)
+    {
+        size_t at = index_find(pid);
+        if (at == table.index_cap)
+        {
+            // Not a background job, e.g. a stopped foreground command
+            continue;
+        }
+        struct pid_entry e = table.index[at];
+        reaped += stage_done(e.slot, e.stage, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), &ru);
+    }
+    return reaped;
+}
+
+static bool can_start(void)
+{
+    return max_running == 0 || table.running < max_running;
+}
+
+// Start queued jobs, oldest first, for as long as the limit allows
+static void start_pending(void)
+{
+    while (table.pending_head >= 0 && can_start())
+    {
+        int slot = table.pending_head;
+        struct job *j = &table.slots[slot];
+        table.pending_head = j->next;
+        if (table.pending_head < 0)
+        {
+            table.pending_tail = -1;
+        }
+        table.n_pending--;
+        struct pending_job *p = j->pending;
+        j->pending = NULL;
+
+        pid_t *pids;
+        int n;
+        start_background(p->sh, p->tree, &pids, &n);
+        free_pending(p);
+        struct job_stage *stages = n > 0 ? alloc_stages(n) : NULL;
+        if (stages != NULL)
+        {
+            attach_stages(slot, pids, n, stages);
+        }
+        else
+        {
+            // Could not be started: it is simply Done
+            watch_orphans(pids, n);
+            queue_done(slot);
+        }
+    }
+}
+
+int submit_job(struct shell *sh, struct node *n)
+{
+    jobs_init();
+
+    // Jobs start in the order they were submitted
+    if (table.pending_head < 0 && can_start())
+    {
+        pid_t *pids;
+        int count;
+        int status = start_background(sh, n, &pids, &count);
+        int slot = count > 0 ? record_job(pids, count, n, false) : -1;
+        if (slot >= 0)
+        {
+            print_running(&table.slots[slot]);
+        }
+        return status;
+    }
+
+    int slot = alloc_slot();
+    struct pending_job *p = slot >= 0 ? pool_alloc(&table.mem, sizeof(struct pending_job)) : NULL;
+    char *text = NULL;
+    if (p != NULL)
+    {
+        p->sh = sh;
+        arena_init(&p->mem, PENDING_CHUNK);
+        p->tree = node_copy(&p->mem, n);
+        text = job_text(n);
+    }
+    if (p == NULL || p->tree == NULL || text == NULL)
+    {
+        if (slot >= 0)
+        {
+            unalloc_slot(slot);
+        }
+        free_pending(p);
+        if (text != NULL)
+        {
+            pool_free(&table.mem, text, strlen(text) + 1);
+        }
+        fprintf(stderr, "cannot queue job: %s\n", strerror(ENOMEM));
+        return 1;
+    }
+
+    struct job *j = &table.slots[slot];
+    j->job_id = alloc_id();
+    j->pid = 0;
+    j->command = text;
+    j->status = 0;
+    j->active = 1;
+    j->n_stages = 0;
+    j->n_running = 0;
+    j->stages = NULL;
+    j->pending = p;
+    memset(&j->usage, 0, sizeof(j->usage));
+    j->started = j->ended = 0;
+    j->quiet = false;
+    j->next = -1;
+    table.count++;
+    if (table.pending_tail >= 0)
+    {
+        table.slots[table.pending_tail].next = slot;
+    }
+    else
+    {
+        table.pending_head = slot;
+    }
+    table.pending_tail = slot;
+    table.n_pending++;
+
+    printf("[%d] Pending %s &\n", j->job_id, j->command);
+    return 0;
+}
+
+void jobs_set_limit(int max)
+{
+    max_running = max;
+    start_pending();
+}
+
+int jobs_limit(void)
+{
+    return max_running;
+}
+
+int jobs_pending(void)
+{
+    return table.n_pending;
+}
+
+void jobs_wait_pending(void)
+{
+    while (table.pending_head >= 0)
+    {
+        struct pollfd pfd = {.fd = jobs_event_fd(), .events = POLLIN};
+        if (pfd.fd < 0 || (poll(&pfd, 1, -1) < 0 && errno != EINTR))
+        {
+            return;
+        }
+        check_jobs();
+    }
+}
+
+int jobs_reap(void)
+{
+    int reaped;
+    if (use_pidfd)
+    {
+        // Nothing to ask the kernel while no job is running, but a SIGCHLD
+        // still has to be drained from the pipe once that is set up
+        reaped = n_live > 0 || sigchld_seen ? reap_pidfds() : 0;
+    }
+    else
+    {
+        reaped = reap_sigchld();
+    }
+    start_pending();
+    return reaped;
+}
+
+bool jobs_live(void)
+{
+    return n_live > 0;
+}
+
+bool jobs_child_exited(pid_t pid, int wst, const struct rusage *ru)
+{
+    size_t at = index_find(pid);
+    if (at == table.index_cap || WIFSTOPPED(wst))
+    {
+        return false;
+    }
+    struct pid_entry e = table.index[at];
+    struct job_stage *st = &table.slots[e.slot].stages[e.stage];
+    if (st->pidfd >= 0)
+    {
+        unwatch_fd(st->pidfd);
+    }
+    for (int i = 0; i < table.n_unwatched; i++)
+    {
+        if (table.unwatched[i].slot == e.slot && table.unwatched[i].stage == e.stage)
+        {
+            table.unwatched[i] = table.unwatched[--table.n_unwatched];
+            break;
+        }
+    }
+    stage_done(e.slot, e.stage, WIFEXITED(wst) ? WEXITSTATUS(wst) : 128 + WTERMSIG(wst), ru);
+    return true;
+}
+
+// The exit status of a finished job, that of its last stage
+static int job_status(const struct job *j)
+{
+    return j->n_stages > 0 ? j->stages[j->n_stages - 1].status : 1;
+}
+
+static uint64_t job_real(const struct job *j)
+{
+    return j->ended > j->started ? j->ended - j->started : 0;
+}
+
+// Remember a reported job for jobs -l, over the oldest one
+static void keep_finished(const struct job *j)
+{
+    struct finished_job *f = &finished.jobs[finished.next];
+    if (finished.count == JOBS_FINISHED && f->command != NULL)
+    {
+        pool_free(&finished.mem, f->command, strlen(f->command) + 1);
+    }
+    finished.count += finished.count < JOBS_FINISHED;
+    finished.next = (finished.next + 1) % JOBS_FINISHED;
+
+    f->job_id = j->job_id;
+    f->pid = j->pid;
+    f->status = job_status(j);
+    f->command = pool_strdup(&finished.mem, j->command);
+    f->real_ns = job_real(j);
+    f->usage = j->usage;
+}
+
+static void print_done(const struct job *j)
+{
+    if (j->pid == 0)
+    {
+        // A queued job that could not be started has no pid
+        printf("[%d] Done %s &\n", j->job_id, j->command);
+    }
+    else
+    {
+        printf("[%d] %d Done %s &\n", j->job_id, j->pid, j->command);
+    }
+}
+
+int check_jobs()
+{
+    jobs_reap();
+
+    int done = 0;
+    while (table.done_head >= 0)
+    {
+        int slot = table.done_head;
+        struct job *j = &table.slots[slot];
+        print_done(j);
+        keep_finished(j);
+        table.done_head = j->next;
+        if (table.done_head < 0)
+        {
+            table.done_tail = -1;
+        }
+        release_slot(slot);
+        done++;
+    }
+    if (done > 0)
+    {
+        fflush(stdout);
+    }
+    return done;
+}
+
+static int by_job_id(const void *a, const void *b)
+{
+    return (*(struct job *const *)a)->job_id - (*(struct job *const *)b)->job_id;
+}
+
+static void list_jobs(bool usage)
+{
+    if (table.count == 0)
+    {
+        return;
+    }
+    struct job **list = malloc(table.count * sizeof(struct job *));
+    if (list == NULL)
+    {
+        return;
+    }
+    int n = 0;
+    for (int i = 0; i < table.used; i++)
+    {
+        if (table.slots[i].job_id != 0 && !table.slots[i].quiet)
+        {
+            list[n++] = &table.slots[i];
+        }
+    }
+    qsort(list, n, sizeof(list[0]), by_job_id);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (list[i]->pending != NULL)
+        {
+            printf("[%d] Pending %s &\n", list[i]->job_id, list[i]->command);
+        }
+        else if (list[i]->active == 1 && list[i]->status == 0)
+        {
+
+            printf("[%d] %d Running %s &\n", list[i]->job_id, list[i]->pid, list[i]->command);
+        }
+        else
+        {
+            print_done(list[i]);
+            if (usage)
+            {
+                usage_print_line(stdout, job_status(list[i]), job_real(list[i]), &list[i]->usage);
+            }
+        }
+    }
+    free(list);
+}
+
+void show_jobs()
+{
+    list_jobs(false);
+}
+
+void show_jobs_long(void)
+{
+    list_jobs(true);
+    for (int i = 0; i < finished.count; i++)
+    {
+        const struct finished_job *f =
+            &finished.jobs[(finished.next - finished.count + i + JOBS_FINISHED) % JOBS_FINISHED];
+        const char *command = f->command != NULL ? f->command : "";
+        if (f->pid == 0)
+        {
+            printf("[%d] Done %s &\n", f->job_id, command);
+        }
+        else
+        {
+            printf("[%d] %d Done %s &\n", f->job_id, f->pid, command);
+        }
+        usage_print_line(stdout, f->status, f->real_ns, &f->usage);
+    }
+}
+
+void cleanup_jobs()
+{
+    free_jobs(true);
+}
@@ -1,4 +1,6 @@
 #include "../src/lab.h"
+#include "scan.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,75 +25,6 @@
  * @return const char* The prompt
  */
 
-// Structure to store background job information
-
-struct job jobs[MAX_JOBS];
-int n_jobs = 0;
-
-void add_job(pid_t pid, char **argv)
-{
-    if (n_jobs < MAX_JOBS)
-    {
-        jobs[n_jobs].job_id = n_jobs + 1;
-        jobs[n_jobs].pid = pid;
-        jobs[n_jobs].command = strdup(argv[0]);
-        jobs[n_jobs].status = 0;
-        jobs[n_jobs].active = 1;
-
-        if (argv[1] != NULL)
-        {
-            printf("[%d] %d Running %s %s &\n", jobs[n_jobs].job_id, jobs[n_jobs].pid, jobs[n_jobs].command, argv[1]);
-        }
-        else
-        {
-            printf("[%d] %d Running %s &\n", jobs[n_jobs].job_id, jobs[n_jobs].pid, jobs[n_jobs].command);
-        }
-
-        n_jobs++;
-    }
-}
-
-void check_jobs()
-{
-    int status;
-    for (int i = 0; i < n_jobs; i++)
-    {
-        if (jobs[i].active)
-        {
-            pid_t result = waitpid(jobs[i].pid, &status, WNOHANG);
-            if (result > 0)
-            {
-                jobs[i].active = 0;
-                jobs[i].status = 1;
-            }
-        }
-    }
-}
-
-void show_jobs()
-{
-    for (int i = 0; i < n_jobs; i++)
-    {
-        if (jobs[i].active == 1 && jobs[i].status == 0)
-        {
-
-            printf("[%d] %d Running %s &\n", jobs[i].job_id, jobs[i].pid, jobs[i].command);
-        }
-        else
-        {
-            printf("[%d] %d Done %s &\n", jobs[i].job_id, jobs[i].pid, jobs[i].command);
-        }
-    }
-}
-
-void cleanup_jobs()
-{
-    for (int i = 0; i < n_jobs; i++)
-    {
-        free(jobs[i].command);
-    }
-}
-
 char *get_prompt(const char *env)
 {
     char *prompt = NULL;
@@ -170,9 +103,9 @@ int change_dir(char **dir)
 
 /**
  * @brief Convert line read from the user into to format that will work with
- * execvp. We limit the number of arguments to ARG_MAX loaded from sysconf.
- * This function allocates memory that must be reclaimed with the cmd_free
- * function.
+ * execvp. The argv array and the bytes of every token are packed into a
+ * single allocation sized to the actual token count, so the whole result
+ * is released by one call to cmd_free.
  *
  * @param line The line to process
  *
@@ -186,50 +119,73 @@ char **cmd_parse(char const *line)
         return NULL;
     }
 
-    long arg_max = sysconf(_SC_ARG_MAX);
-    if (arg_max == -1)
+    size_t n = strlen(line);
+
+    // First pass: classify the line 64 bytes at a time. A token starts at a
+    // word byte whose predecessor is a delimiter, so the token count and the
+    // bytes they need (with their NUL) fall out of two popcounts per block.
+    size_t argc = 0;
+    size_t bytes = 0;
+    uint64_t carry = 0;
+    for (size_t base = 0; base < n; base += 64)
     {
-        perror("sysconf failed");
-        return NULL;
+        size_t len = n - base < 64 ? n - base : 64;
+        uint64_t valid = len == 64 ? ~(uint64_t)0 : ((uint64_t)1 << len) - 1;
+        uint64_t word = ~scan_mask64(line + base, len, SCAN_DELIM) & valid;
+        uint64_t starts = word & ~((word << 1) | carry);
+        argc += (size_t)__builtin_popcountll(starts);
+        bytes += (size_t)__builtin_popcountll(word);
+        carry = word >> 63;
     }
+    bytes += argc;
 
-    char **argv = malloc(sizeof(char *) * (arg_max + 1));
+    // One block: argv[0..argc] followed by the token bytes
+    char **argv = malloc(sizeof(char *) * (argc + 1) + bytes);
     if (argv == NULL)
     {
-        free(argv);
         perror("malloc failed");
         return NULL;
     }
 
-    char *line_copy = strdup(line);
-    if (line_copy == NULL)
-    {
-        free(argv);
-        perror("strdup failed");
-        return NULL;
-    }
-
-    char *token = strtok(line_copy, " \t\n");
-    int argc = 0;
-
-    while (token != NULL && argc < arg_max)
+    // Second pass: walk the token edges in order and copy each token into
+    // the block behind the pointer array. An edge is either a token start
+    // or the delimiter (or end of line) right after a token.
+    char *out = (char *)(argv + argc + 1);
+    size_t k = 0;
+    size_t start = 0;
+    carry = 0;
+    for (size_t base = 0; base < n; base += 64)
     {
-        argv[argc] = strdup(token);
-        if (argv[argc] == NULL)
+        size_t len = n - base < 64 ? n - base : 64;
+        uint64_t valid = len == 64 ? ~(uint64_t)0 : ((uint64_t)1 << len) - 1;
+        uint64_t word = ~scan_mask64(line + base, len, SCAN_DELIM) & valid;
+        uint64_t edges = word ^ ((word << 1) | carry);
+        while (edges)
         {
-            cmd_free(argv);
-            free(line_copy);
-            perror("strdup failed");
-            return NULL;
+            int b = __builtin_ctzll(edges);
+            edges &= edges - 1;
+            if ((word >> b) & 1)
+            {
+                start = base + (size_t)b;
+                continue;
+            }
+            size_t tok = base + (size_t)b - start;
+            memcpy(out, line + start, tok);
+            out[tok] = '\0';
+            argv[k++] = out;
+            out += tok + 1;
         }
-        argc++;
-        token = strtok(NULL, " \t\n");
+        carry = word >> 63;
+    }
+    if (carry)
+    {
+        memcpy(out, line + start, n - start);
+        out[n - start] = '\0';
+        argv[k++] = out;
     }
 
     argv[argc] = NULL;
 
-    free(line_copy);
-
     return argv;
 }
 
@@ -240,21 +196,8 @@ char **cmd_parse(char const *line)
  */
 void cmd_free(char **line)
 {
-    if (line == NULL)
-    {
-        return;
-    }
-    else
-    {
-        int k = 0;
-        while (line[k] != NULL)
-        {
-            free(line[k]);
-            k++;
-        }
-
-        free(line);
-    }
+    // The tokens live in the same block as the array itself
+    free(line);
 }
 
 /**
@@ -268,107 +211,21 @@ void cmd_free(char **line)
  */
 char *trim_white(char *line)
 {
-    char *end;
+    size_t n = strlen(line);
+    size_t lead = scan_span(line, n, SCAN_SPACE);
 
-    while (isspace((unsigned char)*line))
-        line++;
-
-    if (*line == 0)
+    line += lead;
+    n -= lead;
+    if (n == 0)
     {
         return line;
     }
 
-    end = line + strlen(line) - 1;
-    while (end > line && isspace((unsigned char)*end))
-        end--;
-
-    *(end + 1) = '\0';
+    line[n - scan_rspan(line, n, SCAN_SPACE)] = '\0';
 
     return line;
 }
 
-/**
- * @brief Takes an argument list and checks if the first argument is a
- * built in command such as exit, cd, jobs, etc. If the command is a
- * built in command this function will handle the command and then return
- * true. If the first argument is NOT a built in command this function will
- * return false.
- *
- * @param sh The shell
- * @param argv The command to check
- * @return True if the command was a built in command
- */
-
-bool do_builtin(struct shell *sh, char **argv)
-{
-    if (argv == NULL || argv[0] == NULL)
-    {
-        return false;
-    }
-
-    if (strcmp(argv[0], "exit") == 0)
-    {
-        sh_destroy(sh);
-        exit(0);
-    }
-
-    if (strcmp(argv[0], "cd") == 0)
-    {
-        int directory_changed = change_dir(argv);
-
-        if (directory_changed == 0)
-        {
-            return true;
-        }
-
-        return false;
-    }
-
-    if (strcmp(argv[0], "pwd") == 0)
-    {
-        char cwd[PATH_MAX];
-
-        if (getcwd(cwd, sizeof(cwd)) != NULL)
-        {
-            printf("%s\n", cwd);
-            return true;
-        }
-        else
-        {
-            printf("Error: %s\n", strerror(errno));
-            return false;
-        }
-
-        return false;
-    }
-
-    if (strcmp(argv[0], "history") == 0)
-    {
-        HIST_ENTRY **h_list;
-        h_list = history_list();
-        if (h_list)
-        {
-            for (int i = 0; h_list[i]; i++)
-            {
-                printf("%d %s\n", i + history_base, h_list[i]->line);
-            }
-        }
-        else
-        {
-            printf(" No History");
-        }
-        return true;
-    }
-
-    if (strcmp(argv[0], "jobs") == 0)
-    {
-        show_jobs();
-        return true;
-    }
-
-    return false;
-}
-
 /**
  * @brief Initialize the shell for use. Allocate all data structures
  * Grab control of the terminal and put the shell in its own
@@ -382,14 +239,33 @@ bool do_builtin(struct shell *sh, char **argv)
 
 void sh_init(struct shell *sh)
 {
-    sh->prompt = get_prompt("MY_PROMPT");
+    const char *spawn = getenv("MY_SPAWN");
+    sh->spawn_mode = SPAWN_POSIX;
+    if (spawn != NULL && strcmp(spawn, "fork") == 0)
+    {
+        sh->spawn_mode = SPAWN_FORK;
+    }
+    else if (spawn != NULL && strcmp(spawn, "zygote") == 0 && zygote_start() > 0)
+    {
+        // First thing, while the shell is still small
+        sh->spawn_mode = SPAWN_ZYGOTE;
+    }
     sh->shell_terminal = STDIN_FILENO;
-    sh->shell_is_interactive = isatty(sh->shell_terminal);
 
+    // -c and scripts go straight to work: no prompt, no terminal
+    if (sh->command != NULL || sh->script != NULL)
+    {
+        sh->shell_is_interactive = 0;
+        return;
+    }
+
+    sh->prompt = get_prompt("MY_PROMPT");
+    sh->shell_is_interactive = isatty(sh->shell_terminal);
     if (!sh->shell_is_interactive)
     {
         return;
     }
+    jobs_init();
 
     while (tcgetpgrp(sh->shell_terminal) != (sh->shell_pgid = getpgrp()))
     {
@@ -428,21 +304,77 @@ void sh_destroy(struct shell *sh)
     {
         free(sh->prompt);
     }
+    path_destroy(&sh->paths);
+    arena_destroy(&sh->mem);
+    zygote_stop();
+    // A script that never stopped its trace still leaves a complete file
+    trace_stop();
+}
+
+int sh_run_line(struct shell *sh, const char *line, bool last)
+{
+    check_jobs();
+
+    struct node *tree;
+    uint64_t start = stats_now();
+    int parsed = parse_line(&sh->mem, line, &tree);
+    stats_record(&sh->stats, STAT_PARSE, start, line);
+    if (parsed < 0)
+    {
+        sh->last_status = 2;
+    }
+    else if (tree != NULL)
+    {
+        if (last)
+        {
+            execute_last(sh, tree);
+        }
+        else
+        {
+            execute(sh, tree);
+        }
+    }
+
+    arena_reset(&sh->mem);
+    return sh->last_status;
 }
 
-void parse_args(int argc, char **argv)
+int sh_run_string(struct shell *sh, char *s)
+{
+    uint64_t start = stats_now();
+    char *cmd = trim_white(s);
+    stats_record(&sh->stats, STAT_TRIM, start, NULL);
+    if (*cmd == '\0')
+    {
+        return sh->last_status;
+    }
+    // The last command of `-c 'cmd'` replaces the shell, as in sh
+    sh_run_line(sh, cmd, true);
+    stats_record(&sh->stats, STAT_LINE, start, cmd);
+    return sh->last_status;
+}
+
+void parse_args(struct shell *sh, int argc, char **argv)
 {
     int opt;
-    while ((opt = getopt(argc, argv, "v")) != -1)
+    // '+': the options end at the script name, its arguments are its own
+    while ((opt = getopt(argc, argv, "+vc:")) != -1)
     {
         switch (opt)
         {
         case 'v':
             printf("Shell version: %d.%d\n", lab_VERSION_MAJOR, lab_VERSION_MINOR);
             break;
+        case 'c':
+            sh->command = optarg;
+            break;
         default:
             fprintf(stderr, "unkonwn arg");
             exit(EXIT_FAILURE);
         }
     }
+    if (sh->command == NULL && optind < argc)
+    {
+        sh->script = argv[optind];
+    }
 }
\ No newline at end of file
@@ -4,21 +4,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <unistd.h>
 #include <signal.h>
 #include <ctype.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include "parse.h"
+#include "stats.h"
 
 #define lab_VERSION_MAJOR 1
 #define lab_VERSION_MINOR 0
 #define UNUSED(x) (void)x;
 
-#define MAX_JOBS 4096
 #define PATH_MAX 4096
 
-// #define MAX_JOBS 1024
 // #define PATH_MAX 4096
 
 #ifdef __cplusplus
@@ -27,6 +29,40 @@ extern "C"
 {
 #endif
 
+    /**
+     * How external commands are started. posix_spawn (a vfork-style clone
+     * in glibc) is the default; the fork path is kept for children that have
+     * to run shell code before exec and can be forced with MY_SPAWN=fork.
+     * MY_SPAWN=zygote hands the spawns to a fork server instead.
+     */
+    enum spawn_mode
+    {
+        SPAWN_POSIX,
+        SPAWN_FORK,
+        SPAWN_ZYGOTE,
+    };
+
+    struct path_entry
+    {
+        char *name; // NULL for an empty slot
+        char *path;
+        uint32_t hash;
+        unsigned hits;
+    };
+
+    /**
+     * Remembers where commands were found in PATH: an open addressing hash
+     * table with linear probing from command name to resolved path. The
+     * table is dropped whenever PATH changes.
+     */
+    struct path_cache
+    {
+        struct path_entry *slots;
+        size_t cap; // always a power of two
+        size_t count;
+        char *path_env; // the PATH the entries were resolved against
+    };
+
     struct shell
     {
         int shell_is_interactive;
@@ -34,24 +70,211 @@ extern "C"
         struct termios shell_tmodes;
         int shell_terminal;
         char *prompt;
+        int last_status;
+        enum spawn_mode spawn_mode;
+        struct path_cache paths;
+        char *command; // the -c string, NULL otherwise
+        const char *script; // the script file to run, NULL otherwise
+        struct arena mem; // everything one command line needs, reset after it
+        struct stats stats; // where the time of each line went, for the stats built in
+        struct rusage *usage; // while time runs, where foreground children's usage adds up
+    };
+
+    // One process of a job; a pipeline has one per stage
+    struct job_stage
+    {
+        pid_t pid;
+        int pidfd;
+        int status; // exit status once done, 128 + signal if killed
+        bool done;
     };
 
+    struct pending_job;
+
     struct job
     {
         int job_id;
-        pid_t pid;
-        char *command;
+        pid_t pid; // the first stage, which is also the process group
+        char *command; // the whole command line, in the job table's pool
         int status;
         int active;
+        int n_stages;
+        int n_running;
+        struct job_stage *stages;
+        struct pending_job *pending; // set while the job waits under maxjobs
+        struct rusage usage; // summed over the stages that have exited
+        uint64_t started; // stats_now times, ended is 0 until every stage exited
+        uint64_t ended;
+        bool quiet; // a task of a built in, never listed or reported
+        int next; // free list, pending or report queue link, internal to jobs.c
     };
 
+    /**
+     * @brief Run a tree in the background as one job. While fewer than
+     * maxjobs jobs are running it is started at once; otherwise a copy of
+     * the tree is queued as a Pending job, which is started in order as
+     * running jobs are reaped.
+     *
+     * @param sh The shell, which must outlive the queued job
+     * @param n The command, pipeline or list to run, shown in full in the
+     * job listing
+     * @return 0, or the exit status of a job that could not be started
+     */
+    int submit_job(struct shell *sh, struct node *n);
+
+    /**
+     * @brief Start the processes of a background job without recording it
+     * anywhere. Used by submit_job, now or once a queued job's turn comes.
+     *
+     * @param sh The shell
+     * @param n The command, pipeline or list to run
+     * @param pids Set to the started pids, allocated from sh->mem
+     * @param count Set to the number of pids
+     * @return 0, or the exit status of a job that could not be started
+     */
+    int start_background(struct shell *sh, struct node *n, pid_t **pids, int *count);
+
+    /**
+     * @brief Set how many background jobs may run at once. Queued jobs
+     * that fit under a raised limit are started right away.
+     *
+     * @param max The limit, 0 for none (the default)
+     */
+    void jobs_set_limit(int max);
+
+    /**
+     * @brief The current limit on running background jobs, 0 for none.
+     */
+    int jobs_limit(void);
+
+    /**
+     * @brief The number of background jobs queued under maxjobs.
+     */
+    int jobs_pending(void);
+
+    /**
+     * @brief Block until every queued job has been started. A script calls
+     * this before exiting so that no queued job is silently dropped.
+     */
+    void jobs_wait_pending(void);
+
+    /**
+     * @brief Record a background job and print its Running line. The job
+     * is watched through a pidfd when the kernel has them.
+     *
+     * @param pid The pid of the job
+     * @param argv The command, used for the job listing
+     * @return 0 on success, -1 if the job table could not grow (the child
+     * is still reaped, just not listed)
+     */
+    int add_job(pid_t pid, char **argv);
 
-    void add_job(pid_t pid, char **argv);
-  
-    void check_jobs();
+    /**
+     * @brief Record a background pipeline as a single job. Each stage is
+     * watched on its own and keeps its exit status; the job is Done once
+     * every stage has exited.
+     *
+     * @param pids The pids of the stages, first to last
+     * @param n The number of stages
+     * @param argv The command, shown in full in the job listing
+     * @return 0 on success, -1 if the job table could not grow
+     */
+    int add_pipeline_job(const pid_t *pids, int n, char **argv);
+
+    /**
+     * @brief Record a process a built in runs on the shell's behalf, such as
+     * a parallel task. It is reaped like any job but never printed or
+     * listed; its exit status is picked up with jobs_collect instead.
+     *
+     * @param pid The pid of the task
+     * @param argv The command
+     * @return 0 on success, -1 if the job table could not grow
+     */
+    int add_task_job(pid_t pid, char **argv);
+
+    /**
+     * @brief Take one finished task from add_task_job, oldest first. Call
+     * jobs_reap first to notice the ones that exited.
+     *
+     * @param status Set to the exit status of the task
+     * @return The pid of the task, or 0 if no task has finished
+     */
+    pid_t jobs_collect(int *status);
+
+    /**
+     * @brief Find the job a pid belongs to, in constant time. Processes
+     * are no longer found once they have been reaped.
+     *
+     * @param pid The pid of any stage of the job
+     * @return The job, or NULL if pid is not a running background job
+     */
+    struct job *job_find(pid_t pid);
+
+    /**
+     * @brief Reap the background jobs that finished since the last call and
+     * print a Done line for each. Only does work once a job's pidfd (or,
+     * without pidfd, SIGCHLD) signaled, and then only for the exited ones.
+     *
+     * @return The number of jobs that finished
+     */
+    int check_jobs();
+
+    /**
+     * @brief Like check_jobs but without printing anything; the finished
+     * jobs are reported by the next check_jobs call, which also frees their
+     * slots and job ids for reuse. Queued jobs are started as running ones
+     * make room.
+     *
+     * @return The number of jobs that finished
+     */
+    int jobs_reap(void);
+
+    /**
+     * @brief Whether any background process is still running.
+     */
+    bool jobs_live(void);
+
+    /**
+     * @brief Hand the job table a child that exited under someone else's
+     * wait, such as a background job reaped while the shell waited for the
+     * foreground, so that its end time is when it exited rather than when
+     * the shell got around to it. It is reported by the next check_jobs.
+     *
+     * @param pid The child
+     * @param wst Its wait status
+     * @param ru What it used
+     * @return True if it was a background job, false for anything else,
+     * including a job that only stopped
+     */
+    bool jobs_child_exited(pid_t pid, int wst, const struct rusage *ru);
+
+    /**
+     * @brief Set up the epoll instance that watches background jobs, using
+     * pidfds if the kernel has them and a SIGCHLD handler otherwise.
+     * MY_JOB_EVENTS=sigchld forces the fallback. add_job and jobs_event_fd
+     * call it on demand; safe to call more than once. In a forked child of
+     * the shell it first drops the jobs inherited from the parent.
+     */
+    void jobs_init(void);
+
+    /**
+     * @brief A descriptor that becomes readable when a background job
+     * finishes. The input loop polls it next to stdin to report finished
+     * jobs the moment they happen, while the user is still typing.
+     *
+     * @return The descriptor, or -1 if jobs_init failed
+     */
+    int jobs_event_fd(void);
 
     void show_jobs();
 
+    /**
+     * @brief jobs -l: like show_jobs, followed by the jobs that finished
+     * most recently with their exit status, wall clock time and resource
+     * usage (user and sys time, max RSS, context switches, page faults).
+     */
+    void show_jobs_long(void);
+
     void cleanup_jobs();
 
     /**
@@ -79,9 +302,9 @@ extern "C"
 
     /**
      * @brief Convert line read from the user into to format that will work with
-     * execvp. We limit the number of arguments to ARG_MAX loaded from sysconf.
-     * This function allocates memory that must be reclaimed with the cmd_free
-     * function.
+     * execvp. The argv array and all token bytes are packed into a single
+     * allocation sized to the number of tokens. This function allocates
+     * memory that must be reclaimed with the cmd_free function.
      *
      * @param line The line to process
      *
@@ -108,12 +331,34 @@ extern "C"
      */
     char *trim_white(char *line);
 
+    /**
+     * A built in command. The handler runs in the shell process and returns
+     * the exit status of the command.
+     */
+    struct builtin
+    {
+        const char *name;
+        int (*run)(struct shell *sh, char **argv);
+    };
+
+    /**
+     * @brief Find a built in command by name. A name longer than every
+     * built in is rejected after reading one byte past that length, any
+     * other is hashed into a fixed table kept at most half full and
+     * compared with the few entries on its probe sequence, so a command
+     * that is not a built in costs about the same however many exist.
+     *
+     * @param name The command name
+     * @return The built in, or NULL if there is none by that name
+     */
+    const struct builtin *builtin_find(const char *name);
+
     /**
      * @brief Takes an argument list and checks if the first argument is a
      * built in command such as exit, cd, jobs, etc. If the command is a
      * built in command this function will handle the command and then return
      * true. If the first argument is NOT a built in command this function will
-     * return false.
+     * return false. The exit status of the built in is stored in sh->last_status.
      *
      * @param sh The shell
      * @param argv The command to check
@@ -121,6 +366,177 @@ extern "C"
      */
     bool do_builtin(struct shell *sh, char **argv);
 
+    /**
+     * @brief Check if a command name is one of the built in commands handled
+     * by do_builtin.
+     *
+     * @param name The command name
+     * @return True if the command is a built in command
+     */
+    bool is_builtin(const char *name);
+
+    /**
+     * @brief Run a parsed line. Lists, && and || are evaluated in the shell,
+     * built in commands run in the shell process and everything else is
+     * handed to create_process. The exit status of the last command run is
+     * stored in sh->last_status.
+     *
+     * @param sh The shell
+     * @param n The root of the syntax tree from parse_line
+     * @return The exit status of the line
+     */
+    int execute(struct shell *sh, struct node *n);
+
+    /**
+     * @brief Like execute, for the last line the shell will ever run (the
+     * end of a -c string). If that line ends in an external command, the
+     * command is exec'ed in place of the shell instead of started in a
+     * child, which saves a whole process for `myprogram -c 'cmd'`.
+     *
+     * @param sh The shell
+     * @param n The root of the syntax tree from parse_line
+     * @return The exit status of the line, when the shell is still there
+     */
+    int execute_last(struct shell *sh, struct node *n);
+
+    /**
+     * @brief Parse and run one command line. The syntax tree, the words and
+     * anything else the line needs only while it runs come from sh->mem,
+     * which is reset before returning; whatever has to outlive the line
+     * (job records, queued jobs, history) is copied out by its owner.
+     *
+     * @param sh The shell
+     * @param line The trimmed, non-empty line
+     * @param last True for the last line the shell will run, see execute_last
+     * @return The exit status of the line, 2 for a syntax error
+     */
+    int sh_run_line(struct shell *sh, const char *line, bool last);
+
+    /**
+     * @brief Run the string given to -c. Like sh, the whole string is
+     * parsed as one input, so quotes and backslash-newlines can span its
+     * lines, and a syntax error anywhere runs none of it. Its last command
+     * may replace the shell, see execute_last.
+     *
+     * @param sh The shell
+     * @param s The string, trimmed in place
+     * @return The exit status of the string, 2 for a syntax error
+     */
+    int sh_run_string(struct shell *sh, char *s);
+
+    /**
+     * @brief Start a simple command or a pipeline in new child processes.
+     * Foreground commands get the terminal and are waited for; background
+     * commands are added to the job table.
+     *
+     * @param cmd A NODE_COMMAND or NODE_PIPELINE node
+     * @param sh The shell
+     * @param background True to run the command as a background job
+     * @return The exit status of the command, 0 for background commands
+     */
+    int create_process(struct node *cmd, struct shell *sh, bool background);
+
+    /**
+     * @brief Find the executable for a command. Names containing a slash are
+     * returned unchanged. Other names are looked up in the cache first and
+     * searched in PATH on a miss, and the result is remembered.
+     *
+     * @param pc The cache
+     * @param name The command name
+     * @param count_hit True to count the lookup as a use of the command
+     * @return The path owned by the cache, or NULL if it was not found
+     */
+    const char *path_lookup(struct path_cache *pc, const char *name, bool count_hit);
+
+    /**
+     * @brief Drop one command from the cache, e.g. because the cached path
+     * no longer exists.
+     *
+     * @param pc The cache
+     * @param name The command name
+     */
+    void path_forget(struct path_cache *pc, const char *name);
+
+    /**
+     * @brief Drop every remembered command (hash -r).
+     *
+     * @param pc The cache
+     */
+    void path_clear(struct path_cache *pc);
+
+    /**
+     * @brief Print the hit count and path of every remembered command.
+     *
+     * @param pc The cache
+     */
+    void path_print(struct path_cache *pc);
+
+    /**
+     * @brief Free all memory held by the cache.
+     *
+     * @param pc The cache
+     */
+    void path_destroy(struct path_cache *pc);
+
+    /**
+     * Descriptors a spawned child gets on top of the shell's own: the pipe
+     * ends of a pipeline stage (-1 leaves stdin or stdout alone), then the
+     * command's redirections. All of it is done in the child as
+     * posix_spawn file actions.
+     */
+    struct spawn_io
+    {
+        int in;
+        int out;
+        struct redir *redirs;
+    };
+
+    /**
+     * @brief Start an external command without copying the shell. Uses
+     * posix_spawn with the job control signals reset to their defaults, the
+     * child put in process group pgid and, for foreground jobs, given the
+     * terminal. Process groups and the terminal are only touched when the
+     * shell is interactive.
+     *
+     * @param sh The shell
+     * @param path The executable to run
+     * @param argv The command
+     * @param pgid The process group to join, 0 to start a new one
+     * @param foreground True to hand the terminal to the child
+     * @param io The child's pipe ends and redirections, NULL for none
+     * @param pid Set to the pid of the child
+     * @return 0 on success, otherwise the errno value of the failed exec
+     */
+    int spawn_process(struct shell *sh, const char *path, char **argv, pid_t pgid, bool foreground,
+                      const struct spawn_io *io, pid_t *pid);
+
+    /**
+     * @brief Fork the fork server: a helper that starts commands for the
+     * shell from its own small copy of the process. Call it early, before
+     * the shell has grown. Its children are still the shell's children.
+     *
+     * @return The pid of the server, or -1 if it could not be started
+     */
+    int zygote_start(void);
+
+    /**
+     * @brief Stop the fork server and wait for it. Does nothing without one
+     * or in a forked child of the shell.
+     */
+    void zygote_stop(void);
+
+    /**
+     * @brief spawn_process through the fork server: the descriptors the
+     * child needs are sent along with the command and set up in the child
+     * as posix_spawn would, including the process group and terminal.
+     *
+     * @return 0 on success, the errno value of a failed start, or -1 when
+     * the server cannot take the command (not running, called from a forked
+     * child, too many descriptors) and it has to be spawned directly
+     */
+    int zygote_spawn(struct shell *sh, const char *path, char **argv, pid_t pgid, bool foreground,
+                     const struct spawn_io *io, pid_t *pid);
+
     /**
      * @brief Initialize the shell for use. Allocate all data structures
      * Grab control of the terminal and put the shell in its own
@@ -129,6 +545,10 @@ extern "C"
      * this function to fail because the debugger maintains control of
      * the subprocess it is debugging.
      *
+     * With a -c string or a script (see parse_args) the shell is never
+     * interactive: the terminal, the prompt and the job event machinery are
+     * left alone so that startup costs as little as possible.
+     *
      * @param sh
      */
     void sh_init(struct shell *sh);
@@ -141,13 +561,16 @@ extern "C"
     void sh_destroy(struct shell *sh);
 
     /**
-     * @brief Parse command line args from the user when the shell was launched
+     * @brief Parse command line args from the user when the shell was
+     * launched: -v, -c 'command' or a script file. The first operand after
+     * the options is the script; anything after it is ignored.
      *
+     * @param sh The shell, gets the command or script to run
      * @param argc Number of args
      * @param argv The arg array
      */
 
-    void parse_args(int argc, char **argv);
+    void parse_args(struct shell *sh, int argc, char **argv);
 
 #ifdef __cplusplus
 } // extern "C"
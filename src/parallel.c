@@ -0,0 +1,405 @@
+#define _GNU_SOURCE
+#include "builtin.h"
+#include "input.h"
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * parallel [-j N] command [arg...] [::: item...]
+ *
+ * Runs command once per item, the item replacing every {} in the
+ * arguments or else appended to them, on at most N worker slots at a time.
+ * Without ::: the items are the lines of stdin. Each task is a quiet job in
+ * the job table, so it is spawned and reaped through the same pidfd (or
+ * SIGCHLD) machinery as everything else.
+ *
+ * Scheduling is work stealing: the items are split into one contiguous
+ * deque per worker, a worker takes from the front of its own deque, and a
+ * worker whose deque is empty steals from the back of the fullest one, so
+ * uneven tasks still keep every slot busy.
+ *
+ * A task's stdout and stderr go to memfds owned by its worker and are
+ * copied out in one piece when it finishes, so output is grouped per task
+ * and never interleaved. The exit status is the number of failed tasks,
+ * capped at 101, as in GNU parallel.
+ */
+#define PARALLEL_FAILED_MAX 101
+#define PARALLEL_USAGE 255
+
+struct worker
+{
+    int head; // own deque is items[head, tail)
+    int tail;
+    pid_t pid; // the running task, 0 when idle
+    int out;
+    int err;
+};
+
+struct parallel
+{
+    struct shell *sh;
+    struct arena mem;
+    char **cmd; // the command and its fixed arguments
+    int n_cmd;
+    char **items;
+    int n_items;
+    struct worker *workers;
+    int n_workers;
+    int failed;
+};
+
+// Copy word with every {} replaced by item
+static char *replace_braces(struct arena *a, const char *word, const char *item)
+{
+    size_t n = 0;
+    size_t item_len = strlen(item);
+    for (const char *p = word; *p != '\0'; p++)
+    {
+        n += (p[0] == '{' && p[1] == '}') ? item_len : 1;
+        p += p[0] == '{' && p[1] == '}';
+    }
+
+    char *out = arena_alloc(a, n + 1);
+    if (out == NULL)
+    {
+        return NULL;
+    }
+    char *o = out;
+    for (const char *p = word; *p != '\0'; p++)
+    {
+        if (p[0] == '{' && p[1] == '}')
+        {
+            memcpy(o, item, item_len);
+            o += item_len;
+            p++;
+        }
+        else
+        {
+            *o++ = *p;
+        }
+    }
+    *o = '\0';
+    return out;
+}
+
+// The command line of one task: the items go in place of {} or at the end
+static struct node *task_node(struct parallel *pl, struct worker *w, const char *item)
+{
+    struct arena *a = &pl->mem;
+    struct node *n = arena_alloc(a, sizeof(struct node));
+    char **argv = arena_alloc(a, sizeof(char *) * (size_t)(pl->n_cmd + 2));
+    struct redir *r = arena_alloc(a, sizeof(struct redir) * 3);
+    if (n == NULL || argv == NULL || r == NULL)
+    {
+        return NULL;
+    }
+
+    int argc = 0;
+    bool placed = false;
+    for (int i = 0; i < pl->n_cmd; i++)
+    {
+        if (strstr(pl->cmd[i], "{}") != NULL)
+        {
+            argv[argc] = replace_braces(a, pl->cmd[i], item);
+            placed = true;
+        }
+        else
+        {
+            argv[argc] = pl->cmd[i];
+        }
+        if (argv[argc++] == NULL)
+        {
+            return NULL;
+        }
+    }
+    if (!placed)
+    {
+        argv[argc++] = (char *)item;
+    }
+    argv[argc] = NULL;
+
+    // < /dev/null 1>&out 2>&err, done in the child by the spawn path
+    r[0] = (struct redir){.type = REDIR_IN, .fd = STDIN_FILENO, .path = (char *)"/dev/null", .next = &r[1]};
+    r[1] = (struct redir){.type = REDIR_DUP, .fd = STDOUT_FILENO, .target_fd = w->out, .next = &r[2]};
+    r[2] = (struct redir){.type = REDIR_DUP, .fd = STDERR_FILENO, .target_fd = w->err, .next = NULL};
+
+    n->type = NODE_COMMAND;
+    n->cmd.argc = argc;
+    n->cmd.argv = argv;
+    n->cmd.redirs = r;
+    return n;
+}
+
+// Own deque first, then the back half of whoever has the most left
+static int next_item(struct parallel *pl, struct worker *w)
+{
+    if (w->head < w->tail)
+    {
+        return w->head++;
+    }
+
+    struct worker *victim = NULL;
+    for (int i = 0; i < pl->n_workers; i++)
+    {
+        struct worker *v = &pl->workers[i];
+        if (v->tail - v->head > (victim ? victim->tail - victim->head : 0))
+        {
+            victim = v;
+        }
+    }
+    if (victim == NULL)
+    {
+        return -1;
+    }
+    return --victim->tail;
+}
+
+// Copy what a finished task wrote, then empty the file for the next one
+static void flush_output(int from, int to)
+{
+    char buf[16384];
+    ssize_t n;
+
+    lseek(from, 0, SEEK_SET);
+    while ((n = read(from, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t off = 0; off < n;)
+        {
+            ssize_t w = write(to, buf + off, (size_t)(n - off));
+            if (w < 0 && errno != EINTR)
+            {
+                break;
+            }
+            off += w > 0 ? w : 0;
+        }
+    }
+    ftruncate(from, 0);
+    lseek(from, 0, SEEK_SET);
+}
+
+// Start the worker's next task; false once there is nothing left to run
+static bool launch(struct parallel *pl, struct worker *w)
+{
+    int item;
+    while ((item = next_item(pl, w)) >= 0)
+    {
+        struct node *n = task_node(pl, w, pl->items[item]);
+        if (n == NULL)
+        {
+            fprintf(stderr, "parallel: %s\n", strerror(ENOMEM));
+            pl->failed++;
+            continue;
+        }
+
+        pid_t *pids;
+        int count;
+        start_background(pl->sh, n, &pids, &count);
+        if (count == 0)
+        {
+            pl->failed++;
+            continue;
+        }
+        w->pid = pids[0];
+        if (add_task_job(w->pid, n->cmd.argv) < 0)
+        {
+            // Not in the table: wait for it here rather than lose it
+            int st;
+            waitpid(w->pid, &st, 0);
+            w->pid = 0;
+            pl->failed += !(WIFEXITED(st) && WEXITSTATUS(st) == 0);
+            fflush(stdout);
+            flush_output(w->out, STDOUT_FILENO);
+            flush_output(w->err, STDERR_FILENO);
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+static int run_tasks(struct parallel *pl)
+{
+    int running = 0;
+    for (int i = 0; i < pl->n_workers; i++)
+    {
+        running += launch(pl, &pl->workers[i]);
+    }
+
+    struct pollfd pfd = {.fd = jobs_event_fd(), .events = POLLIN};
+    while (running > 0)
+    {
+        jobs_reap();
+        pid_t pid;
+        int status;
+        bool any = false;
+        while ((pid = jobs_collect(&status)) > 0)
+        {
+            any = true;
+            for (int i = 0; i < pl->n_workers; i++)
+            {
+                struct worker *w = &pl->workers[i];
+                if (w->pid != pid)
+                {
+                    continue;
+                }
+                fflush(stdout);
+                flush_output(w->out, STDOUT_FILENO);
+                flush_output(w->err, STDERR_FILENO);
+                pl->failed += status != 0;
+                w->pid = 0;
+                running--;
+                running += launch(pl, w);
+                break;
+            }
+        }
+        if (!any && running > 0 && poll(&pfd, 1, -1) < 0 && errno != EINTR)
+        {
+            perror("parallel: poll");
+            break;
+        }
+    }
+    return pl->failed > PARALLEL_FAILED_MAX - 1 ? PARALLEL_FAILED_MAX : pl->failed;
+}
+
+// One item per line of stdin, copied into the arena
+static int read_items(struct parallel *pl)
+{
+    struct line_reader in;
+    size_t cap = 0;
+    char *line;
+    size_t len;
+
+    reader_init(&in, STDIN_FILENO);
+    while ((line = reader_line(&in, &len)) != NULL)
+    {
+        if (pl->n_items == (int)cap)
+        {
+            size_t grown = cap ? cap * 2 : 64;
+            char **items = arena_alloc(&pl->mem, sizeof(char *) * grown);
+            if (items == NULL)
+            {
+                break;
+            }
+            memcpy(items, pl->items, sizeof(char *) * cap);
+            pl->items = items;
+            cap = grown;
+        }
+        if ((pl->items[pl->n_items] = arena_strndup(&pl->mem, line, len)) == NULL)
+        {
+            break;
+        }
+        pl->n_items++;
+    }
+    reader_destroy(&in);
+    return pl->n_items;
+}
+
+static int parse_jobs(const char *arg)
+{
+    char *end;
+    errno = 0;
+    long n = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE || n < 0 || n > INT_MAX)
+    {
+        return -1;
+    }
+    return (int)n;
+}
+
+int builtin_parallel(struct shell *sh, char **argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int jobs = cpus > 0 ? (int)cpus : 1;
+    int i = 1;
+
+    if (argv[i] != NULL && strncmp(argv[i], "-j", 2) == 0)
+    {
+        const char *arg = argv[i][2] != '\0' ? argv[i] + 2 : argv[++i];
+        if (arg == NULL || (jobs = parse_jobs(arg)) < 0)
+        {
+            fprintf(stderr, "parallel: -j: expected a number of jobs\n");
+            return PARALLEL_USAGE;
+        }
+        i++;
+    }
+    if (argv[i] != NULL && strcmp(argv[i], "--") == 0)
+    {
+        i++;
+    }
+
+    struct parallel pl = {.sh = sh, .cmd = argv + i};
+    while (argv[i] != NULL && strcmp(argv[i], ":::") != 0)
+    {
+        i++;
+    }
+    pl.n_cmd = (int)(argv + i - pl.cmd);
+    if (pl.n_cmd == 0)
+    {
+        fprintf(stderr, "parallel: usage: parallel [-j N] command [arg...] [::: item...]\n");
+        return PARALLEL_USAGE;
+    }
+
+    arena_init(&pl.mem, 0);
+    if (argv[i] != NULL)
+    {
+        pl.items = argv + i + 1;
+        while (pl.items[pl.n_items] != NULL)
+        {
+            pl.n_items++;
+        }
+    }
+    else
+    {
+        read_items(&pl);
+    }
+
+    // -j 0 runs everything at once
+    pl.n_workers = jobs == 0 || jobs > pl.n_items ? pl.n_items : jobs;
+    pl.workers = pl.n_workers > 0 ? calloc((size_t)pl.n_workers, sizeof(struct worker)) : NULL;
+    if (pl.n_workers > 0 && pl.workers == NULL)
+    {
+        arena_destroy(&pl.mem);
+        fprintf(stderr, "parallel: %s\n", strerror(ENOMEM));
+        return PARALLEL_USAGE;
+    }
+
+    int status = 0;
+    int ready = 0;
+    for (; ready < pl.n_workers; ready++)
+    {
+        struct worker *w = &pl.workers[ready];
+        w->head = (int)((long)pl.n_items * ready / pl.n_workers);
+        w->tail = (int)((long)pl.n_items * (ready + 1) / pl.n_workers);
+        w->out = memfd_create("parallel-out", MFD_CLOEXEC);
+        w->err = w->out >= 0 ? memfd_create("parallel-err", MFD_CLOEXEC) : -1;
+        if (w->err < 0)
+        {
+            perror("parallel: memfd_create");
+            if (w->out >= 0)
+            {
+                close(w->out);
+            }
+            status = PARALLEL_USAGE;
+            break;
+        }
+    }
+    if (status == 0)
+    {
+        // Tasks of a parallel running in a forked pipeline stage must not
+        // land in the parent shell's event set
+        jobs_init();
+        status = run_tasks(&pl);
+    }
+
+    for (int k = 0; k < ready; k++)
+    {
+        close(pl.workers[k].out);
+        close(pl.workers[k].err);
+    }
+    free(pl.workers);
+    arena_destroy(&pl.mem);
+    return status;
+}
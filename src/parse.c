@@ -0,0 +1,943 @@
+#include "parse.h"
+#include "scan.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <unistd.h>
+
+enum tok_type
+{
+    TOK_WORD,
+    TOK_IO_NUMBER, // digits directly in front of < or >
+    TOK_SEMI,      // ;
+    TOK_AMP,       // &
+    TOK_AND_IF,    // &&
+    TOK_PIPE,      // |
+    TOK_OR_IF,     // ||
+    TOK_LESS,      // <
+    TOK_GREAT,     // > or >|
+    TOK_DGREAT,    // >>
+    TOK_LESSAND,   // <&
+    TOK_GREATAND,  // >&
+    TOK_AND_GREAT, // &>
+    TOK_AND_DGREAT, // &>>
+    TOK_NEWLINE,
+    TOK_EOF,
+};
+
+static const char *tok_names[] = {
+    [TOK_WORD] = "word",
+    [TOK_IO_NUMBER] = "number",
+    [TOK_SEMI] = ";",
+    [TOK_AMP] = "&",
+    [TOK_AND_IF] = "&&",
+    [TOK_PIPE] = "|",
+    [TOK_OR_IF] = "||",
+    [TOK_LESS] = "<",
+    [TOK_GREAT] = ">",
+    [TOK_DGREAT] = ">>",
+    [TOK_LESSAND] = "<&",
+    [TOK_GREATAND] = ">&",
+    [TOK_AND_GREAT] = "&>",
+    [TOK_AND_DGREAT] = "&>>",
+    [TOK_NEWLINE] = "newline",
+    [TOK_EOF] = "newline",
+};
+
+struct parser
+{
+    struct arena *a;
+    const char *p;   // next unread byte
+    const char *end; // the NUL at the end of the input
+    char *scratch;   // room for the longest possible word
+    enum tok_type tok;
+    char *word; // value of the current TOK_WORD or TOK_IO_NUMBER
+    bool error;
+};
+
+// Small linked lists used while the size of an argv or pipeline is unknown
+struct item
+{
+    void *value;
+    struct item *next;
+};
+
+static void syntax_error(struct parser *ps, const char *msg)
+{
+    if (!ps->error)
+    {
+        fprintf(stderr, "syntax error: %s\n", msg);
+    }
+    ps->error = true;
+    ps->tok = TOK_EOF;
+}
+
+static void unexpected(struct parser *ps)
+{
+    if (!ps->error)
+    {
+        const char *name = ps->tok == TOK_WORD ? ps->word : tok_names[ps->tok];
+        fprintf(stderr, "syntax error near unexpected token `%s'\n", name);
+    }
+    ps->error = true;
+    ps->tok = TOK_EOF;
+}
+
+static void *parser_alloc(struct parser *ps, size_t size)
+{
+    void *p = arena_alloc(ps->a, size);
+    if (p == NULL)
+    {
+        ps->error = true;
+        ps->tok = TOK_EOF;
+    }
+    return p;
+}
+
+static bool all_digits(const char *s, size_t n)
+{
+    if (n == 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (s[i] < '0' || s[i] > '9')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Read one word starting at p, removing quotes and backslashes. Plain runs
+ * are copied in bulk with the vector scanner; only the bytes that end a run
+ * (quotes, backslashes, operators and blanks) are looked at one by one.
+ */
+static const char *lex_word(struct parser *ps, const char *p)
+{
+    const char *end = ps->end;
+    char *buf = ps->scratch;
+    size_t len = 0;
+    bool quoted = false;
+
+    while (p < end)
+    {
+        size_t run = scan_cspan(p, (size_t)(end - p), SCAN_META);
+        memcpy(buf + len, p, run);
+        len += run;
+        p += run;
+        if (p == end)
+        {
+            break;
+        }
+
+        if (*p == '\\')
+        {
+            quoted = true;
+            p++;
+            if (p == end)
+            {
+                buf[len++] = '\\';
+            }
+            else if (*p == '\n')
+            {
+                p++;
+            }
+            else
+            {
+                buf[len++] = *p++;
+            }
+        }
+        else if (*p == '\'')
+        {
+            const char *close = memchr(p + 1, '\'', (size_t)(end - p - 1));
+            if (close == NULL)
+            {
+                syntax_error(ps, "unterminated single quote");
+                return end;
+            }
+            memcpy(buf + len, p + 1, (size_t)(close - p - 1));
+            len += (size_t)(close - p - 1);
+            p = close + 1;
+            quoted = true;
+        }
+        else if (*p == '"')
+        {
+            p++;
+            quoted = true;
+            while (p < end && *p != '"')
+            {
+                if (*p == '\\' && p + 1 < end && strchr("$`\"\\\n", p[1]) != NULL)
+                {
+                    if (p[1] != '\n')
+                    {
+                        buf[len++] = p[1];
+                    }
+                    p += 2;
+                }
+                else
+                {
+                    buf[len++] = *p++;
+                }
+            }
+            if (p == end)
+            {
+                syntax_error(ps, "unterminated double quote");
+                return end;
+            }
+            p++;
+        }
+        else if (*p == '#')
+        {
+            // Only starts a comment at the beginning of a word
+            buf[len++] = *p++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    ps->word = arena_strndup(ps->a, buf, len);
+    if (ps->word == NULL)
+    {
+        ps->error = true;
+        ps->tok = TOK_EOF;
+        return end;
+    }
+    ps->tok = (!quoted && all_digits(buf, len) && (*p == '<' || *p == '>')) ? TOK_IO_NUMBER : TOK_WORD;
+    return p;
+}
+
+static void lex_next(struct parser *ps)
+{
+    const char *p = ps->p;
+
+    if (ps->error)
+    {
+        ps->tok = TOK_EOF;
+        return;
+    }
+
+    // Skip blanks, line continuations and comments
+    for (;;)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (p[0] == '\\' && p[1] == '\n')
+        {
+            p += 2;
+            continue;
+        }
+        if (*p == '#')
+        {
+            while (p < ps->end && *p != '\n')
+                p++;
+        }
+        break;
+    }
+
+    ps->word = NULL;
+    if (p == ps->end)
+    {
+        ps->tok = TOK_EOF;
+        ps->p = p;
+        return;
+    }
+
+    // The input is NUL terminated, so peeking one or two bytes ahead is safe
+    switch (*p)
+    {
+    case '\n':
+        ps->tok = TOK_NEWLINE;
+        p++;
+        break;
+    case ';':
+        ps->tok = TOK_SEMI;
+        p++;
+        break;
+    case '&':
+        if (p[1] == '&')
+        {
+            ps->tok = TOK_AND_IF;
+            p += 2;
+        }
+        else if (p[1] == '>' && p[2] == '>')
+        {
+            ps->tok = TOK_AND_DGREAT;
+            p += 3;
+        }
+        else if (p[1] == '>')
+        {
+            ps->tok = TOK_AND_GREAT;
+            p += 2;
+        }
+        else
+        {
+            ps->tok = TOK_AMP;
+            p++;
+        }
+        break;
+    case '|':
+        ps->tok = p[1] == '|' ? TOK_OR_IF : TOK_PIPE;
+        p += ps->tok == TOK_OR_IF ? 2 : 1;
+        break;
+    case '<':
+        ps->tok = p[1] == '&' ? TOK_LESSAND : TOK_LESS;
+        p += ps->tok == TOK_LESSAND ? 2 : 1;
+        break;
+    case '>':
+        if (p[1] == '>')
+        {
+            ps->tok = TOK_DGREAT;
+            p += 2;
+        }
+        else if (p[1] == '&')
+        {
+            ps->tok = TOK_GREATAND;
+            p += 2;
+        }
+        else
+        {
+            ps->tok = TOK_GREAT;
+            p += p[1] == '|' ? 2 : 1;
+        }
+        break;
+    default:
+        p = lex_word(ps, p);
+        break;
+    }
+    ps->p = p;
+}
+
+static void skip_newlines(struct parser *ps)
+{
+    while (ps->tok == TOK_NEWLINE)
+        lex_next(ps);
+}
+
+static bool is_redir_op(enum tok_type t)
+{
+    return t == TOK_LESS || t == TOK_GREAT || t == TOK_DGREAT || t == TOK_LESSAND ||
+           t == TOK_GREATAND || t == TOK_AND_GREAT || t == TOK_AND_DGREAT;
+}
+
+static struct node *new_node(struct parser *ps, enum node_type type)
+{
+    struct node *n = parser_alloc(ps, sizeof(struct node));
+    if (n != NULL)
+    {
+        memset(n, 0, sizeof(struct node));
+        n->type = type;
+    }
+    return n;
+}
+
+static struct redir *parse_redirect(struct parser *ps, int fd)
+{
+    enum tok_type op = ps->tok;
+    lex_next(ps);
+    if (ps->tok != TOK_WORD)
+    {
+        unexpected(ps);
+        return NULL;
+    }
+
+    struct redir *r = parser_alloc(ps, sizeof(struct redir));
+    if (r == NULL)
+    {
+        return NULL;
+    }
+    r->next = NULL;
+    r->path = NULL;
+    r->target_fd = -1;
+
+    char *word = ps->word;
+    switch (op)
+    {
+    case TOK_LESS:
+        r->type = REDIR_IN;
+        r->fd = fd < 0 ? 0 : fd;
+        r->path = word;
+        break;
+    case TOK_GREAT:
+        r->type = REDIR_OUT;
+        r->fd = fd < 0 ? 1 : fd;
+        r->path = word;
+        break;
+    case TOK_DGREAT:
+        r->type = REDIR_APPEND;
+        r->fd = fd < 0 ? 1 : fd;
+        r->path = word;
+        break;
+    case TOK_LESSAND:
+    case TOK_GREATAND:
+        r->fd = fd < 0 ? (op == TOK_LESSAND ? 0 : 1) : fd;
+        if (strcmp(word, "-") == 0)
+        {
+            r->type = REDIR_CLOSE;
+        }
+        else if (all_digits(word, strlen(word)) && strlen(word) < 10)
+        {
+            r->type = REDIR_DUP;
+            r->target_fd = atoi(word);
+        }
+        else if (op == TOK_GREATAND && fd < 0)
+        {
+            // >&file is the old spelling of &>file
+            r->type = REDIR_OUT_ERR;
+            r->path = word;
+        }
+        else
+        {
+            syntax_error(ps, "ambiguous redirect");
+            return NULL;
+        }
+        break;
+    case TOK_AND_GREAT:
+        r->type = REDIR_OUT_ERR;
+        r->fd = 1;
+        r->path = word;
+        break;
+    default:
+        r->type = REDIR_APPEND_ERR;
+        r->fd = 1;
+        r->path = word;
+        break;
+    }
+
+    lex_next(ps);
+    return r;
+}
+
+static struct node *parse_command(struct parser *ps)
+{
+    struct item *words = NULL;
+    struct item **wtail = &words;
+    struct redir *redirs = NULL;
+    struct redir **rtail = &redirs;
+    int argc = 0;
+
+    for (;;)
+    {
+        if (ps->tok == TOK_WORD)
+        {
+            struct item *it = parser_alloc(ps, sizeof(struct item));
+            if (it == NULL)
+            {
+                return NULL;
+            }
+            it->value = ps->word;
+            it->next = NULL;
+            *wtail = it;
+            wtail = &it->next;
+            argc++;
+            lex_next(ps);
+            continue;
+        }
+
+        int fd = -1;
+        if (ps->tok == TOK_IO_NUMBER)
+        {
+            long n = strtol(ps->word, NULL, 10);
+            if (strlen(ps->word) > 9 || n > INT_MAX)
+            {
+                syntax_error(ps, "bad file descriptor number");
+                return NULL;
+            }
+            fd = (int)n;
+            lex_next(ps);
+        }
+
+        if (!is_redir_op(ps->tok))
+        {
+            break;
+        }
+        struct redir *r = parse_redirect(ps, fd);
+        if (r == NULL)
+        {
+            return NULL;
+        }
+        *rtail = r;
+        rtail = &r->next;
+    }
+
+    if (ps->error)
+    {
+        return NULL;
+    }
+    if (argc == 0 && redirs == NULL)
+    {
+        unexpected(ps);
+        return NULL;
+    }
+
+    struct node *n = new_node(ps, NODE_COMMAND);
+    char **argv = parser_alloc(ps, sizeof(char *) * ((size_t)argc + 1));
+    if (n == NULL || argv == NULL)
+    {
+        return NULL;
+    }
+    int i = 0;
+    for (struct item *it = words; it != NULL; it = it->next)
+    {
+        argv[i++] = it->value;
+    }
+    argv[argc] = NULL;
+    n->cmd.argc = argc;
+    n->cmd.argv = argv;
+    n->cmd.redirs = redirs;
+    return n;
+}
+
+static struct node *parse_pipeline(struct parser *ps)
+{
+    // A keyword rather than a command, so that it times the whole pipeline
+    if (ps->tok == TOK_WORD && strcmp(ps->word, "time") == 0)
+    {
+        struct node *t = new_node(ps, NODE_TIME);
+        if (t == NULL)
+        {
+            return NULL;
+        }
+        lex_next(ps);
+        t->child = NULL;
+        if (ps->tok == TOK_WORD || ps->tok == TOK_IO_NUMBER || is_redir_op(ps->tok))
+        {
+            t->child = parse_pipeline(ps);
+            return t->child != NULL ? t : NULL;
+        }
+        return t;
+    }
+
+    struct node *first = parse_command(ps);
+    if (first == NULL || ps->tok != TOK_PIPE)
+    {
+        return first;
+    }
+
+    struct item head = {first, NULL};
+    struct item *tail = &head;
+    int n = 1;
+    while (ps->tok == TOK_PIPE)
+    {
+        lex_next(ps);
+        skip_newlines(ps);
+        struct node *cmd = parse_command(ps);
+        struct item *it = cmd ? parser_alloc(ps, sizeof(struct item)) : NULL;
+        if (it == NULL)
+        {
+            return NULL;
+        }
+        it->value = cmd;
+        it->next = NULL;
+        tail->next = it;
+        tail = it;
+        n++;
+    }
+
+    struct node *pl = new_node(ps, NODE_PIPELINE);
+    struct node **stages = parser_alloc(ps, sizeof(struct node *) * (size_t)n);
+    if (pl == NULL || stages == NULL)
+    {
+        return NULL;
+    }
+    int i = 0;
+    for (struct item *it = &head; it != NULL; it = it->next)
+    {
+        stages[i++] = it->value;
+    }
+    pl->pipe.n = n;
+    pl->pipe.stages = stages;
+    return pl;
+}
+
+static struct node *parse_and_or(struct parser *ps)
+{
+    struct node *left = parse_pipeline(ps);
+    while (left != NULL && (ps->tok == TOK_AND_IF || ps->tok == TOK_OR_IF))
+    {
+        enum node_type type = ps->tok == TOK_AND_IF ? NODE_AND : NODE_OR;
+        lex_next(ps);
+        skip_newlines(ps);
+        struct node *right = parse_pipeline(ps);
+        struct node *n = right ? new_node(ps, type) : NULL;
+        if (n == NULL)
+        {
+            return NULL;
+        }
+        n->pair.left = left;
+        n->pair.right = right;
+        left = n;
+    }
+    return left;
+}
+
+static struct node *parse_list(struct parser *ps)
+{
+    struct node *list = NULL;
+
+    skip_newlines(ps);
+    while (ps->tok != TOK_EOF)
+    {
+        struct node *item = parse_and_or(ps);
+        if (item == NULL)
+        {
+            return NULL;
+        }
+
+        if (ps->tok == TOK_AMP)
+        {
+            struct node *bg = new_node(ps, NODE_BACKGROUND);
+            if (bg == NULL)
+            {
+                return NULL;
+            }
+            bg->child = item;
+            item = bg;
+            lex_next(ps);
+        }
+        else if (ps->tok == TOK_SEMI || ps->tok == TOK_NEWLINE)
+        {
+            lex_next(ps);
+        }
+        else if (ps->tok != TOK_EOF)
+        {
+            unexpected(ps);
+            return NULL;
+        }
+
+        if (list == NULL)
+        {
+            list = item;
+        }
+        else
+        {
+            struct node *seq = new_node(ps, NODE_SEQUENCE);
+            if (seq == NULL)
+            {
+                return NULL;
+            }
+            seq->pair.left = list;
+            seq->pair.right = item;
+            list = seq;
+        }
+        skip_newlines(ps);
+    }
+    return list;
+}
+
+int parse_line(struct arena *a, const char *line, struct node **out)
+{
+    *out = NULL;
+    if (line == NULL)
+    {
+        return 0;
+    }
+
+    size_t n = strlen(line);
+    struct parser ps = {
+        .a = a,
+        .p = line,
+        .end = line + n,
+        .scratch = arena_alloc(a, n + 1),
+        .error = false,
+    };
+    if (ps.scratch == NULL)
+    {
+        return -1;
+    }
+
+    lex_next(&ps);
+    struct node *root = parse_list(&ps);
+    if (ps.error)
+    {
+        return -1;
+    }
+    *out = root;
+    return 0;
+}
+
+bool parse_incomplete(const char *line)
+{
+    const char *p = line;
+    while (*p != '\0')
+    {
+        if (*p == '\\')
+        {
+            if (p[1] == '\0')
+            {
+                return true;
+            }
+            p += 2;
+        }
+        else if (*p == '\'')
+        {
+            p = strchr(p + 1, '\'');
+            if (p == NULL)
+            {
+                return true;
+            }
+            p++;
+        }
+        else if (*p == '"')
+        {
+            p++;
+            while (*p != '"')
+            {
+                if (*p == '\0')
+                {
+                    return true;
+                }
+                p += (p[0] == '\\' && p[1] != '\0') ? 2 : 1;
+            }
+            p++;
+        }
+        else if (*p == '#' && (p == line || strchr(" \t\n;&|<>", p[-1]) != NULL))
+        {
+            // A comment, where quotes and backslashes mean nothing
+            p += strcspn(p, "\n");
+        }
+        else
+        {
+            p++;
+        }
+    }
+    return false;
+}
+
+static char *copy_word(struct arena *a, const char *s)
+{
+    return arena_strndup(a, s, strlen(s));
+}
+
+struct node *node_copy(struct arena *a, const struct node *n)
+{
+    struct node *c = arena_alloc(a, sizeof(struct node));
+    if (c == NULL)
+    {
+        return NULL;
+    }
+    *c = *n;
+
+    switch (n->type)
+    {
+    case NODE_COMMAND:
+    {
+        c->cmd.argv = arena_alloc(a, sizeof(char *) * (size_t)(n->cmd.argc + 1));
+        if (c->cmd.argv == NULL)
+        {
+            return NULL;
+        }
+        for (int i = 0; i < n->cmd.argc; i++)
+        {
+            if ((c->cmd.argv[i] = copy_word(a, n->cmd.argv[i])) == NULL)
+            {
+                return NULL;
+            }
+        }
+        c->cmd.argv[n->cmd.argc] = NULL;
+
+        struct redir **tail = &c->cmd.redirs;
+        for (const struct redir *r = n->cmd.redirs; r != NULL; r = r->next)
+        {
+            struct redir *rc = arena_alloc(a, sizeof(struct redir));
+            if (rc == NULL)
+            {
+                return NULL;
+            }
+            *rc = *r;
+            if (r->path != NULL && (rc->path = copy_word(a, r->path)) == NULL)
+            {
+                return NULL;
+            }
+            *tail = rc;
+            tail = &rc->next;
+        }
+        *tail = NULL;
+        return c;
+    }
+    case NODE_PIPELINE:
+        c->pipe.stages = arena_alloc(a, sizeof(struct node *) * (size_t)n->pipe.n);
+        if (c->pipe.stages == NULL)
+        {
+            return NULL;
+        }
+        for (int i = 0; i < n->pipe.n; i++)
+        {
+            if ((c->pipe.stages[i] = node_copy(a, n->pipe.stages[i])) == NULL)
+            {
+                return NULL;
+            }
+        }
+        return c;
+    case NODE_BACKGROUND:
+        return (c->child = node_copy(a, n->child)) != NULL ? c : NULL;
+    case NODE_TIME:
+        return n->child == NULL || (c->child = node_copy(a, n->child)) != NULL ? c : NULL;
+    default:
+        c->pair.left = node_copy(a, n->pair.left);
+        c->pair.right = node_copy(a, n->pair.right);
+        return c->pair.left != NULL && c->pair.right != NULL ? c : NULL;
+    }
+}
+
+// Where node_format writes; len keeps counting once size is used up
+struct text_out
+{
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+static void put_text(struct text_out *out, const char *s, size_t n)
+{
+    if (out->len < out->size)
+    {
+        size_t room = out->size - out->len;
+        memcpy(out->buf + out->len, s, n < room ? n : room);
+    }
+    out->len += n;
+}
+
+static void put_str(struct text_out *out, const char *s)
+{
+    put_text(out, s, strlen(s));
+}
+
+// A word as the parser would read it back: bare if it can be, else in ''
+static void put_word(struct text_out *out, const char *w)
+{
+    size_t n = strlen(w);
+    bool bare = n > 0;
+    for (size_t i = 0; i < n && bare; i++)
+    {
+        unsigned char c = (unsigned char)w[i];
+        bare = isalnum(c) || strchr("_-+=@%,./:{}[]^~", c) != NULL;
+    }
+    if (bare)
+    {
+        put_text(out, w, n);
+        return;
+    }
+
+    put_text(out, "'", 1);
+    for (const char *q; (q = strchr(w, '\'')) != NULL; w = q + 1)
+    {
+        put_text(out, w, (size_t)(q - w));
+        put_text(out, "'\\''", 4);
+    }
+    put_str(out, w);
+    put_text(out, "'", 1);
+}
+
+static void put_redir(struct text_out *out, const struct redir *r)
+{
+    char fd[16];
+    // The default descriptor is left out, as people write it
+    int dflt = r->type == REDIR_IN ? STDIN_FILENO : STDOUT_FILENO;
+    snprintf(fd, sizeof(fd), "%d", r->fd);
+    if (r->fd != dflt && r->type != REDIR_OUT_ERR && r->type != REDIR_APPEND_ERR)
+    {
+        put_str(out, fd);
+    }
+
+    switch (r->type)
+    {
+    case REDIR_IN:
+        put_str(out, "< ");
+        break;
+    case REDIR_OUT:
+        put_str(out, "> ");
+        break;
+    case REDIR_APPEND:
+        put_str(out, ">> ");
+        break;
+    case REDIR_OUT_ERR:
+        put_str(out, "&> ");
+        break;
+    case REDIR_APPEND_ERR:
+        put_str(out, "&>> ");
+        break;
+    case REDIR_DUP:
+        snprintf(fd, sizeof(fd), ">&%d", r->target_fd);
+        put_str(out, fd);
+        return;
+    case REDIR_CLOSE:
+        put_str(out, ">&-");
+        return;
+    }
+    put_word(out, r->path);
+}
+
+static void format_node(struct text_out *out, const struct node *n)
+{
+    switch (n->type)
+    {
+    case NODE_COMMAND:
+    {
+        const char *sep = "";
+        for (int i = 0; i < n->cmd.argc; i++, sep = " ")
+        {
+            put_str(out, sep);
+            put_word(out, n->cmd.argv[i]);
+        }
+        for (const struct redir *r = n->cmd.redirs; r != NULL; r = r->next, sep = " ")
+        {
+            put_str(out, sep);
+            put_redir(out, r);
+        }
+        break;
+    }
+    case NODE_PIPELINE:
+        for (int i = 0; i < n->pipe.n; i++)
+        {
+            put_str(out, i > 0 ? " | " : "");
+            format_node(out, n->pipe.stages[i]);
+        }
+        break;
+    case NODE_AND:
+    case NODE_OR:
+    case NODE_SEQUENCE:
+        format_node(out, n->pair.left);
+        if (n->type == NODE_SEQUENCE)
+        {
+            // a & b needs no ; after the &
+            put_str(out, n->pair.left->type == NODE_BACKGROUND ? " " : "; ");
+        }
+        else
+        {
+            put_str(out, n->type == NODE_AND ? " && " : " || ");
+        }
+        format_node(out, n->pair.right);
+        break;
+    case NODE_BACKGROUND:
+        format_node(out, n->child);
+        put_str(out, " &");
+        break;
+    case NODE_TIME:
+        put_str(out, "time");
+        if (n->child != NULL)
+        {
+            put_str(out, " ");
+            format_node(out, n->child);
+        }
+        break;
+    }
+}
+
+size_t node_format(const struct node *n, char *buf, size_t size)
+{
+    struct text_out out = {.buf = buf, .size = size, .len = 0};
+    format_node(&out, n);
+    if (size > 0)
+    {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return out.len;
+}
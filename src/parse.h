@@ -0,0 +1,122 @@
+#ifndef PARSE_H
+#define PARSE_H
+#include "arena.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    enum node_type
+    {
+        NODE_COMMAND,    // simple command: words and redirections
+        NODE_PIPELINE,   // cmd | cmd | ...
+        NODE_AND,        // left && right
+        NODE_OR,         // left || right
+        NODE_SEQUENCE,   // left ; right
+        NODE_BACKGROUND, // child &
+        NODE_TIME,       // time child, where child is a pipeline or NULL
+    };
+
+    enum redir_type
+    {
+        REDIR_IN,         // [n]< file
+        REDIR_OUT,        // [n]> file
+        REDIR_APPEND,     // [n]>> file
+        REDIR_DUP,        // [n]>&m or [n]<&m
+        REDIR_CLOSE,      // [n]>&- or [n]<&-
+        REDIR_OUT_ERR,    // &> file
+        REDIR_APPEND_ERR, // &>> file
+    };
+
+    struct redir
+    {
+        enum redir_type type;
+        int fd;        // the descriptor being redirected
+        int target_fd; // the source descriptor for REDIR_DUP
+        char *path;    // the file for every other type
+        struct redir *next;
+    };
+
+    struct node
+    {
+        enum node_type type;
+        union
+        {
+            struct
+            {
+                int argc;
+                char **argv;
+                struct redir *redirs;
+            } cmd;
+            struct
+            {
+                int n;
+                struct node **stages;
+            } pipe;
+            struct
+            {
+                struct node *left;
+                struct node *right;
+            } pair;
+            struct node *child;
+        };
+    };
+
+    /**
+     * @brief Parse a line of shell input into a syntax tree. Supports
+     * single and double quotes, backslash escapes, comments, the list
+     * operators ; & && || and newline, pipelines, the time keyword in
+     * front of a pipeline, and the redirections < > >> n>&m n>&- &> and
+     * &>>. Every node, word and redirection is
+     * allocated from the arena, so the whole tree is released by resetting
+     * it. Syntax errors are reported on stderr.
+     *
+     * @param a The arena to allocate the tree from
+     * @param line The input to parse
+     * @param out Set to the root of the tree, or NULL for a blank line
+     * @return 0 on success, -1 on a syntax error
+     */
+    int parse_line(struct arena *a, const char *line, struct node **out);
+
+    /**
+     * @brief Tell whether the input stops inside a construct that the next
+     * line continues: an unterminated single or double quote, or a
+     * backslash at the very end. The shell reads further lines onto such
+     * input before parsing it, so a quote or a backslash-newline can span
+     * lines. Follows the quoting and comment rules of parse_line.
+     *
+     * @param line The input so far
+     * @return true if the input needs another line
+     */
+    bool parse_incomplete(const char *line);
+
+    /**
+     * @brief Deep copy a syntax tree, words and redirections included, so
+     * it can outlive the arena it was parsed into.
+     *
+     * @param a The arena to copy into
+     * @param n The root of the tree
+     * @return The copy, or NULL if the arena ran out of memory
+     */
+    struct node *node_copy(struct arena *a, const struct node *n);
+
+    /**
+     * @brief Write a syntax tree back out as a command line that parses to
+     * the same tree, quoting words where needed. Like snprintf, the output
+     * is cut short to fit but the full length is returned, so a first call
+     * with size 0 tells how much room the text needs.
+     *
+     * @param n The root of the tree
+     * @param buf Where to write the text, NUL terminated
+     * @param size The size of buf
+     * @return The length of the full text, not counting the NUL
+     */
+    size_t node_format(const struct node *n, char *buf, size_t size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
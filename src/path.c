@@ -0,0 +1,242 @@
+#include "lab.h"
+#include <string.h>
+#include <sys/stat.h>
+
+// Used when PATH is unset, same as execvp
+#define DEFAULT_PATH "/bin:/usr/bin"
+#define PATH_CACHE_MIN 64
+
+static uint32_t hash_name(const char *s)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *s; s++)
+    {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool is_executable(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+// Walk PATH the way execvp does and return a malloc'ed path or NULL
+static char *search_path(const char *path_env, const char *name)
+{
+    size_t name_len = strlen(name);
+    const char *dir = path_env;
+
+    for (;;)
+    {
+        const char *colon = strchr(dir, ':');
+        size_t dir_len = colon ? (size_t)(colon - dir) : strlen(dir);
+        char candidate[PATH_MAX];
+
+        // An empty entry means the current directory
+        if (dir_len == 0 && name_len + 3 <= sizeof(candidate))
+        {
+            memcpy(candidate, "./", 2);
+            memcpy(candidate + 2, name, name_len + 1);
+            if (is_executable(candidate))
+            {
+                return strdup(candidate);
+            }
+        }
+        else if (dir_len + name_len + 2 <= sizeof(candidate))
+        {
+            memcpy(candidate, dir, dir_len);
+            candidate[dir_len] = '/';
+            memcpy(candidate + dir_len + 1, name, name_len + 1);
+            if (is_executable(candidate))
+            {
+                return strdup(candidate);
+            }
+        }
+
+        if (colon == NULL)
+        {
+            return NULL;
+        }
+        dir = colon + 1;
+    }
+}
+
+static struct path_entry *find_slot(struct path_cache *pc, const char *name, uint32_t h)
+{
+    size_t mask = pc->cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask)
+    {
+        struct path_entry *e = &pc->slots[i];
+        if (e->name == NULL || (e->hash == h && strcmp(e->name, name) == 0))
+        {
+            return e;
+        }
+    }
+}
+
+static bool grow(struct path_cache *pc)
+{
+    size_t cap = pc->cap ? pc->cap * 2 : PATH_CACHE_MIN;
+    struct path_entry *old = pc->slots;
+    size_t old_cap = pc->cap;
+
+    pc->slots = calloc(cap, sizeof(struct path_entry));
+    if (pc->slots == NULL)
+    {
+        pc->slots = old;
+        return false;
+    }
+    pc->cap = cap;
+    for (size_t i = 0; i < old_cap; i++)
+    {
+        if (old[i].name != NULL)
+        {
+            *find_slot(pc, old[i].name, old[i].hash) = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+void path_clear(struct path_cache *pc)
+{
+    for (size_t i = 0; i < pc->cap; i++)
+    {
+        free(pc->slots[i].name);
+        free(pc->slots[i].path);
+    }
+    free(pc->slots);
+    pc->slots = NULL;
+    pc->cap = 0;
+    pc->count = 0;
+}
+
+void path_destroy(struct path_cache *pc)
+{
+    path_clear(pc);
+    free(pc->path_env);
+    pc->path_env = NULL;
+}
+
+// Throw the whole table away when PATH has been reassigned
+static void check_path_env(struct path_cache *pc)
+{
+    const char *env = getenv("PATH");
+    if (env == NULL)
+    {
+        env = DEFAULT_PATH;
+    }
+    if (pc->path_env != NULL && strcmp(pc->path_env, env) == 0)
+    {
+        return;
+    }
+    path_clear(pc);
+    free(pc->path_env);
+    pc->path_env = strdup(env);
+}
+
+const char *path_lookup(struct path_cache *pc, const char *name, bool count_hit)
+{
+    if (strchr(name, '/') != NULL)
+    {
+        return name;
+    }
+
+    check_path_env(pc);
+    if (pc->path_env == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t h = hash_name(name);
+    if (pc->cap != 0)
+    {
+        struct path_entry *e = find_slot(pc, name, h);
+        if (e->name != NULL)
+        {
+            e->hits += count_hit;
+            return e->path;
+        }
+    }
+
+    char *path = search_path(pc->path_env, name);
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    // Keep the load factor at or below one half
+    if ((pc->count + 1) * 2 > pc->cap && !grow(pc))
+    {
+        free(path);
+        return NULL;
+    }
+    struct path_entry *e = find_slot(pc, name, h);
+    e->name = strdup(name);
+    if (e->name == NULL)
+    {
+        free(path);
+        return NULL;
+    }
+    e->path = path;
+    e->hash = h;
+    e->hits = count_hit;
+    pc->count++;
+    return e->path;
+}
+
+void path_forget(struct path_cache *pc, const char *name)
+{
+    if (pc->cap == 0)
+    {
+        return;
+    }
+
+    size_t mask = pc->cap - 1;
+    struct path_entry *e = find_slot(pc, name, hash_name(name));
+    if (e->name == NULL)
+    {
+        return;
+    }
+    free(e->name);
+    free(e->path);
+    e->name = NULL;
+    e->path = NULL;
+    pc->count--;
+
+    // Backward shift deletion keeps every probe sequence unbroken
+    size_t hole = (size_t)(e - pc->slots);
+    for (size_t i = (hole + 1) & mask; pc->slots[i].name != NULL; i = (i + 1) & mask)
+    {
+        size_t home = pc->slots[i].hash & mask;
+        bool movable = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+        if (movable)
+        {
+            pc->slots[hole] = pc->slots[i];
+            pc->slots[i].name = NULL;
+            pc->slots[i].path = NULL;
+            hole = i;
+        }
+    }
+}
+
+void path_print(struct path_cache *pc)
+{
+    if (pc->count == 0)
+    {
+        printf("hash: hash table empty\n");
+        return;
+    }
+    printf("hits\tcommand\n");
+    for (size_t i = 0; i < pc->cap; i++)
+    {
+        if (pc->slots[i].name != NULL)
+        {
+            printf("%4u\t%s\n", pc->slots[i].hits, pc->slots[i].path);
+        }
+    }
+}
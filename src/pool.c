@@ -0,0 +1,116 @@
+#include "pool.h"
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_MIN 16
+#define POOL_MAX (POOL_MIN << (POOL_CLASSES - 1))
+#define POOL_SLAB (64 * 1024)
+
+// Slabs come from an arena, which aligns its chunks for any type
+_Static_assert(POOL_MIN % alignof(max_align_t) == 0, "blocks must stay aligned");
+_Static_assert(sizeof(struct pool_large) <= POOL_MIN, "large header must keep alignment");
+
+// Smallest class that holds size bytes, or POOL_CLASSES if none does
+static int size_class(size_t size)
+{
+    int c = 0;
+    for (size_t cap = POOL_MIN; cap < size; cap <<= 1)
+    {
+        if (++c == POOL_CLASSES)
+        {
+            break;
+        }
+    }
+    return c;
+}
+
+void *pool_alloc(struct pool *p, size_t size)
+{
+    int c = size_class(size);
+    if (c == POOL_CLASSES)
+    {
+        struct pool_large *l = malloc(POOL_MIN + size);
+        if (l == NULL)
+        {
+            perror("malloc failed");
+            return NULL;
+        }
+        l->prev = NULL;
+        l->next = p->large;
+        if (p->large != NULL)
+        {
+            p->large->prev = l;
+        }
+        p->large = l;
+        return (char *)l + POOL_MIN;
+    }
+
+    struct pool_block *b = p->free[c];
+    if (b != NULL)
+    {
+        p->free[c] = b->next;
+        return b;
+    }
+    if (p->slabs.chunk_size == 0)
+    {
+        arena_init(&p->slabs, POOL_SLAB);
+    }
+    return arena_alloc(&p->slabs, (size_t)POOL_MIN << c);
+}
+
+void pool_free(struct pool *p, void *block, size_t size)
+{
+    if (block == NULL)
+    {
+        return;
+    }
+
+    int c = size_class(size);
+    if (c == POOL_CLASSES)
+    {
+        struct pool_large *l = (struct pool_large *)((char *)block - POOL_MIN);
+        if (l->prev != NULL)
+        {
+            l->prev->next = l->next;
+        }
+        else
+        {
+            p->large = l->next;
+        }
+        if (l->next != NULL)
+        {
+            l->next->prev = l->prev;
+        }
+        free(l);
+        return;
+    }
+
+    struct pool_block *b = block;
+    b->next = p->free[c];
+    p->free[c] = b;
+}
+
+char *pool_strdup(struct pool *p, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    char *copy = pool_alloc(p, n);
+    if (copy != NULL)
+    {
+        memcpy(copy, s, n);
+    }
+    return copy;
+}
+
+void pool_destroy(struct pool *p)
+{
+    while (p->large != NULL)
+    {
+        struct pool_large *next = p->large->next;
+        free(p->large);
+        p->large = next;
+    }
+    arena_destroy(&p->slabs);
+    memset(p, 0, sizeof(*p));
+}
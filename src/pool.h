@@ -0,0 +1,80 @@
+#ifndef POOL_H
+#define POOL_H
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define POOL_CLASSES 7 // 16, 32, ... 1024 bytes
+
+    struct pool_block
+    {
+        struct pool_block *next;
+    };
+
+    // A block too big for any class, malloc'ed on its own
+    struct pool_large
+    {
+        struct pool_large *prev;
+        struct pool_large *next;
+    };
+
+    /**
+     * A slab allocator for records that come and go, such as job entries.
+     * Small blocks are rounded up to a power of two and carved out of an
+     * arena; a freed block goes on the free list of its size class and is
+     * handed out again before the arena grows, so a steady stream of
+     * allocations and frees settles at a fixed footprint. Blocks larger
+     * than the biggest class are malloc'ed. pool_destroy releases
+     * everything at once. A zeroed struct pool is an empty pool.
+     */
+    struct pool
+    {
+        struct pool_block *free[POOL_CLASSES];
+        struct pool_large *large;
+        struct arena slabs;
+    };
+
+    /**
+     * @brief Allocate size bytes aligned for any type.
+     *
+     * @param p The pool
+     * @param size The number of bytes
+     * @return The memory, or NULL if malloc failed
+     */
+    void *pool_alloc(struct pool *p, size_t size);
+
+    /**
+     * @brief Give a block back for reuse.
+     *
+     * @param p The pool it came from
+     * @param block The block, NULL is allowed
+     * @param size The size it was allocated with
+     */
+    void pool_free(struct pool *p, void *block, size_t size);
+
+    /**
+     * @brief Copy a string into the pool. Free it with pool_free and a
+     * size of strlen + 1.
+     *
+     * @param p The pool
+     * @param s The string
+     * @return The copy, or NULL if malloc failed
+     */
+    char *pool_strdup(struct pool *p, const char *s);
+
+    /**
+     * @brief Free every block and slab of the pool at once and leave it
+     * empty.
+     *
+     * @param p The pool
+     */
+    void pool_destroy(struct pool *p);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
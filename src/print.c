@@ -0,0 +1,406 @@
+#include "builtin.h"
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+/*
+ * Write the character for the backslash escape starting at s, just past the
+ * backslash. Octal escapes are \nnn in a printf format and \0nnn in echo -e
+ * and %b, which is what zero_octal selects. Sets *stop on \c, which ends
+ * all output. Returns the number of characters used after the backslash.
+ */
+static size_t put_escape(const char *s, bool zero_octal, bool *stop)
+{
+    const char *p = s;
+    int c;
+
+    switch (*p)
+    {
+    case 'a': c = '\a'; break;
+    case 'b': c = '\b'; break;
+    case 'e': c = '\033'; break;
+    case 'f': c = '\f'; break;
+    case 'n': c = '\n'; break;
+    case 'r': c = '\r'; break;
+    case 't': c = '\t'; break;
+    case 'v': c = '\v'; break;
+    case '\\': c = '\\'; break;
+    case 'c':
+        *stop = true;
+        return 1;
+    case 'x':
+        if (!isxdigit((unsigned char)p[1]))
+        {
+            putchar('\\');
+            return 0;
+        }
+        c = 0;
+        for (p++; p - s <= 2 && isxdigit((unsigned char)*p); p++)
+        {
+            c = c * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+        }
+        putchar(c);
+        return (size_t)(p - s);
+    default:
+        if (zero_octal ? *p == '0' : (*p >= '0' && *p <= '7'))
+        {
+            if (zero_octal)
+            {
+                p++;
+            }
+            const char *digits = p;
+            c = 0;
+            for (; p - digits < 3 && *p >= '0' && *p <= '7'; p++)
+            {
+                c = c * 8 + (*p - '0');
+            }
+            putchar(c & 0xff);
+            return (size_t)(p - s);
+        }
+        // Not an escape, keep the backslash
+        putchar('\\');
+        return 0;
+    }
+    putchar(c);
+    return 1;
+}
+
+// Write s with escapes expanded; returns false when \c ended the output
+static bool put_escaped(const char *s, bool zero_octal)
+{
+    bool stop = false;
+    for (; *s != '\0'; s++)
+    {
+        if (*s != '\\' || s[1] == '\0')
+        {
+            putchar(*s);
+            continue;
+        }
+        s += put_escape(s + 1, zero_octal, &stop);
+        if (stop)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int builtin_echo(struct shell *sh, char **argv)
+{
+    (void)sh;
+    bool newline = true;
+    bool escapes = false;
+    int i = 1;
+
+    // Like coreutils, an argument is an option only if every letter is one
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1))
+        {
+            break;
+        }
+        for (const char *o = argv[i] + 1; *o != '\0'; o++)
+        {
+            if (*o == 'n')
+            {
+                newline = false;
+            }
+            else
+            {
+                escapes = *o == 'e';
+            }
+        }
+    }
+
+    for (; argv[i] != NULL; i++)
+    {
+        if (escapes && !put_escaped(argv[i], true))
+        {
+            return 0;
+        }
+        if (!escapes)
+        {
+            fputs(argv[i], stdout);
+        }
+        if (argv[i + 1] != NULL)
+        {
+            putchar(' ');
+        }
+    }
+    if (newline)
+    {
+        putchar('\n');
+    }
+    return 0;
+}
+
+struct printf_args
+{
+    char **next;
+    int status;
+};
+
+static const char *next_arg(struct printf_args *pa)
+{
+    return *pa->next != NULL ? *pa->next++ : NULL;
+}
+
+// Check that strto* used the whole argument, complaining the way coreutils does
+static void check_number(struct printf_args *pa, const char *arg, const char *end)
+{
+    if (errno == ERANGE)
+    {
+        fprintf(stderr, "printf: '%s': %s\n", arg, strerror(ERANGE));
+        pa->status = 1;
+    }
+    else if (end == arg)
+    {
+        fprintf(stderr, "printf: '%s': expected a numeric value\n", arg);
+        pa->status = 1;
+    }
+    else if (*end != '\0')
+    {
+        fprintf(stderr, "printf: '%s': value not completely converted\n", arg);
+        pa->status = 1;
+    }
+}
+
+// 'c and "c give the value of the character c
+static bool char_value(const char *arg, intmax_t *v)
+{
+    if (arg[0] != '\'' && arg[0] != '"')
+    {
+        return false;
+    }
+    *v = (unsigned char)arg[1];
+    return true;
+}
+
+static intmax_t int_arg(struct printf_args *pa)
+{
+    const char *arg = next_arg(pa);
+    intmax_t v;
+    if (arg == NULL)
+    {
+        return 0;
+    }
+    if (char_value(arg, &v))
+    {
+        return v;
+    }
+    char *end;
+    errno = 0;
+    v = strtoimax(arg, &end, 0);
+    check_number(pa, arg, end);
+    return v;
+}
+
+static uintmax_t uint_arg(struct printf_args *pa)
+{
+    const char *arg = next_arg(pa);
+    intmax_t v;
+    if (arg == NULL)
+    {
+        return 0;
+    }
+    if (char_value(arg, &v))
+    {
+        return (uintmax_t)v;
+    }
+    char *end;
+    errno = 0;
+    uintmax_t u = strtoumax(arg, &end, 0);
+    check_number(pa, arg, end);
+    return u;
+}
+
+static long double float_arg(struct printf_args *pa)
+{
+    const char *arg = next_arg(pa);
+    intmax_t v;
+    if (arg == NULL)
+    {
+        return 0;
+    }
+    if (char_value(arg, &v))
+    {
+        return (long double)v;
+    }
+    char *end;
+    errno = 0;
+    long double d = strtold(arg, &end);
+    check_number(pa, arg, end);
+    return d;
+}
+
+/*
+ * Print one conversion. spec holds the flags, width and precision with any
+ * * already replaced by numbers, and room for the length modifier and
+ * conversion character to be appended.
+ */
+static void put_conversion(struct printf_args *pa, char *spec, size_t len, char conv)
+{
+    switch (conv)
+    {
+    case 'd':
+    case 'i':
+        memcpy(spec + len, "jd", 3);
+        printf(spec, int_arg(pa));
+        break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+        spec[len] = 'j';
+        spec[len + 1] = conv;
+        spec[len + 2] = '\0';
+        printf(spec, uint_arg(pa));
+        break;
+    case 'a':
+    case 'A':
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+        spec[len] = 'L';
+        spec[len + 1] = conv;
+        spec[len + 2] = '\0';
+        printf(spec, float_arg(pa));
+        break;
+    case 'c':
+    {
+        const char *arg = next_arg(pa);
+        memcpy(spec + len, "c", 2);
+        printf(spec, arg != NULL ? arg[0] : '\0');
+        break;
+    }
+    default:
+    {
+        const char *arg = next_arg(pa);
+        memcpy(spec + len, "s", 2);
+        printf(spec, arg != NULL ? arg : "");
+        break;
+    }
+    }
+}
+
+/*
+ * Run the format once. Returns false if the output was cut short by \c in
+ * %b or the format was bad, true otherwise.
+ */
+static bool put_format(struct printf_args *pa, const char *fmt)
+{
+    for (const char *p = fmt; *p != '\0'; p++)
+    {
+        if (*p == '\\')
+        {
+            bool stop = false;
+            if (p[1] == '\0')
+            {
+                putchar('\\');
+                continue;
+            }
+            p += put_escape(p + 1, false, &stop);
+            if (stop)
+            {
+                return false;
+            }
+            continue;
+        }
+        if (*p != '%')
+        {
+            putchar(*p);
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            putchar('%');
+            p++;
+            continue;
+        }
+
+        // Room for %, flags, two expanded numbers and the conversion
+        char spec[96];
+        size_t len = 0;
+        const char *start = p++;
+        spec[len++] = '%';
+        for (; *p != '\0' && strchr("-+ #0", *p) != NULL && len < 8; p++)
+        {
+            spec[len++] = *p;
+        }
+        for (int field = 0; field < 2; field++)
+        {
+            if (field == 1)
+            {
+                if (*p != '.')
+                {
+                    break;
+                }
+                spec[len++] = *p++;
+            }
+            if (*p == '*')
+            {
+                len += (size_t)snprintf(spec + len, 24, "%d", (int)int_arg(pa));
+                p++;
+                continue;
+            }
+            for (int digits = 0; isdigit((unsigned char)*p); p++)
+            {
+                if (digits++ < 20)
+                {
+                    spec[len++] = *p;
+                }
+            }
+        }
+
+        if (*p == '\0' || strchr("diouxXaAeEfFgGcsb", *p) == NULL)
+        {
+            fprintf(stderr, "printf: %.*s: invalid conversion specification\n",
+                    (int)(p - start + (*p != '\0')), start);
+            pa->status = 1;
+            return false;
+        }
+        if (*p == 'b')
+        {
+            const char *arg = next_arg(pa);
+            if (arg != NULL && !put_escaped(arg, true))
+            {
+                return false;
+            }
+            continue;
+        }
+        put_conversion(pa, spec, len, *p);
+    }
+    return true;
+}
+
+int builtin_printf(struct shell *sh, char **argv)
+{
+    (void)sh;
+    struct printf_args pa = {.next = argv + 1, .status = 0};
+    // printf -- format, as in every other POSIX utility
+    if (*pa.next != NULL && strcmp(*pa.next, "--") == 0)
+    {
+        pa.next++;
+    }
+    const char *fmt = next_arg(&pa);
+    if (fmt == NULL)
+    {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    // Reuse the format while it keeps consuming arguments
+    for (;;)
+    {
+        char **before = pa.next;
+        if (!put_format(&pa, fmt) || *pa.next == NULL || pa.next == before)
+        {
+            break;
+        }
+    }
+    return pa.status;
+}
@@ -0,0 +1,335 @@
+#include "scan.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#define CLASS_BIT(cls) (1u << (cls))
+#define SEPARATOR_BITS (CLASS_BIT(SCAN_SPACE) | CLASS_BIT(SCAN_DELIM) | CLASS_BIT(SCAN_META))
+
+// Class membership for every byte value, used by the scalar path and for
+// the tails the vector paths leave behind. Independent of the locale.
+static const unsigned char scan_table[256] = {
+    [' '] = SEPARATOR_BITS,
+    ['\t'] = SEPARATOR_BITS,
+    ['\n'] = SEPARATOR_BITS,
+    ['\v'] = CLASS_BIT(SCAN_SPACE),
+    ['\f'] = CLASS_BIT(SCAN_SPACE),
+    ['\r'] = CLASS_BIT(SCAN_SPACE),
+    [';'] = CLASS_BIT(SCAN_META),
+    ['&'] = CLASS_BIT(SCAN_META),
+    ['|'] = CLASS_BIT(SCAN_META),
+    ['<'] = CLASS_BIT(SCAN_META),
+    ['>'] = CLASS_BIT(SCAN_META),
+    ['\''] = CLASS_BIT(SCAN_META),
+    ['"'] = CLASS_BIT(SCAN_META),
+    ['\\'] = CLASS_BIT(SCAN_META),
+    ['#'] = CLASS_BIT(SCAN_META),
+};
+
+static inline int in_class(char c, enum scan_class cls)
+{
+    return scan_table[(unsigned char)c] & CLASS_BIT(cls);
+}
+
+static size_t scalar_span(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = 0;
+    while (i < n && in_class(s[i], cls))
+        i++;
+    return i;
+}
+
+static size_t scalar_cspan(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = 0;
+    while (i < n && !in_class(s[i], cls))
+        i++;
+    return i;
+}
+
+static size_t scalar_rspan(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = n;
+    while (i > 0 && in_class(s[i - 1], cls))
+        i--;
+    return n - i;
+}
+
+static uint64_t scalar_mask64(const char *s, size_t n, enum scan_class cls)
+{
+    uint64_t m = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (in_class(s[i], cls))
+            m |= (uint64_t)1 << i;
+    }
+    return m;
+}
+
+static int scalar_supported(void)
+{
+    return 1;
+}
+
+#ifdef SCAN_X86
+
+/*
+ * The vector paths build a bit mask with one bit per byte that is set when
+ * the byte belongs to the class, then use ctz/clz to find the first or last
+ * byte that ends the run. Loads are unaligned and never go past n; whatever
+ * does not fill a whole vector is finished by the scalar loop. The AVX2
+ * paths hand their tail to the SSE2 ones, so they clear the upper ymm
+ * state first to avoid the AVX/SSE transition penalty.
+ */
+
+__attribute__((target("sse2"))) static inline unsigned sse2_mask(const char *p, enum scan_class cls)
+{
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_cmpeq_epi8(x, _mm_set1_epi8(' '));
+    if (cls == SCAN_SPACE)
+    {
+        // \t \n \v \f \r are the contiguous range 9..13
+        __m128i t = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t));
+    }
+    else
+    {
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+    }
+    if (cls == SCAN_META)
+    {
+        static const char meta[] = ";&|<>'\"\\#";
+        for (size_t k = 0; k < sizeof(meta) - 1; k++)
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(meta[k])));
+    }
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+__attribute__((target("sse2"))) static size_t sse2_span(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned m = ~sse2_mask(s + i, cls) & 0xffffu;
+        if (m)
+            return i + (size_t)__builtin_ctz(m);
+    }
+    return i + scalar_span(s + i, n - i, cls);
+}
+
+__attribute__((target("sse2"))) static size_t sse2_cspan(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned m = sse2_mask(s + i, cls);
+        if (m)
+            return i + (size_t)__builtin_ctz(m);
+    }
+    return i + scalar_cspan(s + i, n - i, cls);
+}
+
+__attribute__((target("sse2"))) static size_t sse2_rspan(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = n;
+    for (; i >= 16; i -= 16)
+    {
+        unsigned m = ~sse2_mask(s + i - 16, cls) & 0xffffu;
+        if (m)
+        {
+            size_t last = i - 16 + (size_t)(31 - __builtin_clz(m));
+            return n - last - 1;
+        }
+    }
+    return n - i + scalar_rspan(s, i, cls);
+}
+
+__attribute__((target("sse2"))) static uint64_t sse2_mask64(const char *s, size_t n, enum scan_class cls)
+{
+    // Short tails are padded with NUL, which is in no class
+    char pad[64];
+    if (n < 64)
+    {
+        memset(pad, 0, sizeof(pad));
+        memcpy(pad, s, n);
+        s = pad;
+    }
+    return (uint64_t)sse2_mask(s, cls) |
+           (uint64_t)sse2_mask(s + 16, cls) << 16 |
+           (uint64_t)sse2_mask(s + 32, cls) << 32 |
+           (uint64_t)sse2_mask(s + 48, cls) << 48;
+}
+
+static int sse2_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("avx2"))) static inline unsigned avx2_mask(const char *p, enum scan_class cls)
+{
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' '));
+    if (cls == SCAN_SPACE)
+    {
+        __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t));
+    }
+    else
+    {
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+    }
+    if (cls == SCAN_META)
+    {
+        static const char meta[] = ";&|<>'\"\\#";
+        for (size_t k = 0; k < sizeof(meta) - 1; k++)
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(meta[k])));
+    }
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2"))) static size_t avx2_span(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned m = ~avx2_mask(s + i, cls);
+        if (m)
+            return i + (size_t)__builtin_ctz(m);
+    }
+    _mm256_zeroupper();
+    return i + sse2_span(s + i, n - i, cls);
+}
+
+__attribute__((target("avx2"))) static size_t avx2_cspan(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned m = avx2_mask(s + i, cls);
+        if (m)
+            return i + (size_t)__builtin_ctz(m);
+    }
+    _mm256_zeroupper();
+    return i + sse2_cspan(s + i, n - i, cls);
+}
+
+__attribute__((target("avx2"))) static size_t avx2_rspan(const char *s, size_t n, enum scan_class cls)
+{
+    size_t i = n;
+    for (; i >= 32; i -= 32)
+    {
+        unsigned m = ~avx2_mask(s + i - 32, cls);
+        if (m)
+        {
+            size_t last = i - 32 + (size_t)(31 - __builtin_clz(m));
+            return n - last - 1;
+        }
+    }
+    _mm256_zeroupper();
+    return n - i + sse2_rspan(s, i, cls);
+}
+
+__attribute__((target("avx2"))) static uint64_t avx2_mask64(const char *s, size_t n, enum scan_class cls)
+{
+    char pad[64];
+    if (n < 64)
+    {
+        memset(pad, 0, sizeof(pad));
+        memcpy(pad, s, n);
+        s = pad;
+    }
+    uint64_t m = (uint64_t)avx2_mask(s, cls) | (uint64_t)avx2_mask(s + 32, cls) << 32;
+    _mm256_zeroupper();
+    return m;
+}
+
+static int avx2_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+struct scan_impl
+{
+    const char *name;
+    int (*supported)(void);
+    size_t (*span)(const char *s, size_t n, enum scan_class cls);
+    size_t (*cspan)(const char *s, size_t n, enum scan_class cls);
+    size_t (*rspan)(const char *s, size_t n, enum scan_class cls);
+    uint64_t (*mask64)(const char *s, size_t n, enum scan_class cls);
+};
+
+// Ordered fastest first; the first supported entry wins
+static const struct scan_impl scan_impls[] = {
+#ifdef SCAN_X86
+    {"avx2", avx2_supported, avx2_span, avx2_cspan, avx2_rspan, avx2_mask64},
+    {"sse2", sse2_supported, sse2_span, sse2_cspan, sse2_rspan, sse2_mask64},
+#endif
+    {"scalar", scalar_supported, scalar_span, scalar_cspan, scalar_rspan, scalar_mask64},
+};
+
+#define N_SCAN_IMPLS (sizeof(scan_impls) / sizeof(scan_impls[0]))
+
+static const struct scan_impl *scan_active = NULL;
+
+static const struct scan_impl *scan_get(void)
+{
+    if (scan_active == NULL)
+    {
+        for (size_t i = 0; i < N_SCAN_IMPLS; i++)
+        {
+            if (scan_impls[i].supported())
+            {
+                scan_active = &scan_impls[i];
+                break;
+            }
+        }
+    }
+    return scan_active;
+}
+
+size_t scan_span(const char *s, size_t n, enum scan_class cls)
+{
+    return scan_get()->span(s, n, cls);
+}
+
+size_t scan_cspan(const char *s, size_t n, enum scan_class cls)
+{
+    return scan_get()->cspan(s, n, cls);
+}
+
+size_t scan_rspan(const char *s, size_t n, enum scan_class cls)
+{
+    return scan_get()->rspan(s, n, cls);
+}
+
+uint64_t scan_mask64(const char *s, size_t n, enum scan_class cls)
+{
+    return scan_get()->mask64(s, n, cls);
+}
+
+const char *scan_impl_name(void)
+{
+    return scan_get()->name;
+}
+
+int scan_set_impl(const char *name)
+{
+    for (size_t i = 0; i < N_SCAN_IMPLS; i++)
+    {
+        if (strcmp(scan_impls[i].name, name) == 0 && scan_impls[i].supported())
+        {
+            scan_active = &scan_impls[i];
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,90 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Byte classes understood by the scanner.
+     *
+     * SCAN_SPACE matches what isspace() accepts in the C locale
+     * (space, \t, \n, \v, \f, \r) and is used by trim_white.
+     * SCAN_DELIM matches the cmd_parse separators (space, \t, \n).
+     * SCAN_META matches every byte that ends a plain run inside a shell
+     * word: the separators, the operators ; & | < > and the quoting
+     * characters ' " \ #.
+     */
+    enum scan_class
+    {
+        SCAN_SPACE,
+        SCAN_DELIM,
+        SCAN_META,
+    };
+
+    /**
+     * @brief Count the leading bytes of s that belong to cls.
+     *
+     * @param s The buffer to scan
+     * @param n The number of bytes in s
+     * @param cls The class to match
+     * @return The length of the initial run of class bytes
+     */
+    size_t scan_span(const char *s, size_t n, enum scan_class cls);
+
+    /**
+     * @brief Count the leading bytes of s that do NOT belong to cls.
+     *
+     * @param s The buffer to scan
+     * @param n The number of bytes in s
+     * @param cls The class to stop at
+     * @return The offset of the first class byte, or n if there is none
+     */
+    size_t scan_cspan(const char *s, size_t n, enum scan_class cls);
+
+    /**
+     * @brief Count the trailing bytes of s that belong to cls.
+     *
+     * @param s The buffer to scan
+     * @param n The number of bytes in s
+     * @param cls The class to match
+     * @return The length of the final run of class bytes
+     */
+    size_t scan_rspan(const char *s, size_t n, enum scan_class cls);
+
+    /**
+     * @brief Classify up to 64 bytes at once. Bit i of the result is set when
+     * s[i] belongs to cls; bits at or past n are always clear. Tokenizers use
+     * this to find all token boundaries of a block with bit arithmetic instead
+     * of testing byte by byte.
+     *
+     * @param s The block to classify
+     * @param n The number of bytes in the block, at most 64
+     * @param cls The class to match
+     * @return The class mask of the block
+     */
+    uint64_t scan_mask64(const char *s, size_t n, enum scan_class cls);
+
+    /**
+     * @brief Name of the implementation in use: "avx2", "sse2" or
+     * "scalar". The fastest one the CPU supports is picked on first use.
+     */
+    const char *scan_impl_name(void);
+
+    /**
+     * @brief Force a specific implementation. Used by the tests and the
+     * benchmarks to compare the vector paths with the scalar one.
+     *
+     * @param name "avx2", "sse2" or "scalar"
+     * @return 0 on success, -1 if the CPU or build does not support it
+     */
+    int scan_set_impl(const char *name);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
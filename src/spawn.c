@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include "lab.h"
+#include <spawn.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+extern char **environ;
+
+// glibc 2.35 can hand the terminal over from inside the spawned child
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
+
+// The signals an interactive shell ignores; a child must get them back
+static const int job_signals[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU};
+
+/*
+ * Turn the pipe ends and redirections of a command into file actions, in
+ * the same order the fork path applies them, so the parent never opens,
+ * dups or closes anything on the child's behalf.
+ */
+static void add_io_actions(posix_spawn_file_actions_t *actions, const struct spawn_io *io)
+{
+    // The pipe ends are O_CLOEXEC; only their dup2 copies survive the exec
+    if (io->in >= 0)
+    {
+        posix_spawn_file_actions_adddup2(actions, io->in, STDIN_FILENO);
+    }
+    if (io->out >= 0)
+    {
+        posix_spawn_file_actions_adddup2(actions, io->out, STDOUT_FILENO);
+    }
+
+    for (const struct redir *r = io->redirs; r != NULL; r = r->next)
+    {
+        switch (r->type)
+        {
+        case REDIR_IN:
+            posix_spawn_file_actions_addopen(actions, r->fd, r->path, O_RDONLY, 0);
+            break;
+        case REDIR_OUT:
+            posix_spawn_file_actions_addopen(actions, r->fd, r->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            break;
+        case REDIR_APPEND:
+            posix_spawn_file_actions_addopen(actions, r->fd, r->path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+            break;
+        case REDIR_OUT_ERR:
+        case REDIR_APPEND_ERR:
+        {
+            int flags = O_WRONLY | O_CREAT | (r->type == REDIR_OUT_ERR ? O_TRUNC : O_APPEND);
+            posix_spawn_file_actions_addopen(actions, r->fd, r->path, flags, 0666);
+            posix_spawn_file_actions_adddup2(actions, r->fd, STDERR_FILENO);
+            break;
+        }
+        case REDIR_DUP:
+            posix_spawn_file_actions_adddup2(actions, r->target_fd, r->fd);
+            break;
+        case REDIR_CLOSE:
+            posix_spawn_file_actions_addclose(actions, r->fd);
+            break;
+        }
+    }
+}
+
+static int spawn_direct(struct shell *sh, const char *path, char **argv, pid_t pgid, bool foreground,
+                        const struct spawn_io *io, pid_t *pid)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t sigdef;
+    sigset_t mask;
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+
+    sigemptyset(&sigdef);
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++)
+    {
+        sigaddset(&sigdef, job_signals[i]);
+    }
+    posix_spawnattr_setsigdefault(&attr, &sigdef);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+
+    // Job control only exists in an interactive shell, like in the fork path
+    if (sh->shell_is_interactive)
+    {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, pgid);
+#ifdef HAVE_SPAWN_TCSETPGRP
+        if (foreground)
+        {
+            posix_spawn_file_actions_addtcsetpgrp_np(&actions, sh->shell_terminal);
+        }
+#endif
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    if (io != NULL)
+    {
+        add_io_actions(&actions, io);
+    }
+
+    int err = posix_spawn(pid, path, &actions, &attr, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return err;
+}
+
+int spawn_process(struct shell *sh, const char *path, char **argv, pid_t pgid, bool foreground,
+                  const struct spawn_io *io, pid_t *pid)
+{
+    // Both ways return once the child has exec'd, or failed to
+    uint64_t start = stats_now();
+    // The fork server takes it unless it is gone or cannot pass everything
+    int err = sh->spawn_mode == SPAWN_ZYGOTE ? zygote_spawn(sh, path, argv, pgid, foreground, io, pid) : -1;
+    if (err < 0)
+    {
+        err = spawn_direct(sh, path, argv, pgid, foreground, io, pid);
+    }
+    stats_record(&sh->stats, STAT_EXEC, start, argv[0]);
+
+    if (err == 0 && sh->shell_is_interactive)
+    {
+        // Same double setpgid as the fork path so the parent never races the
+        // child; fails harmlessly with EACCES once the child has exec'd
+        setpgid(*pid, pgid == 0 ? *pid : pgid);
+#ifndef HAVE_SPAWN_TCSETPGRP
+        if (foreground)
+        {
+            tcsetpgrp(sh->shell_terminal, pgid == 0 ? *pid : pgid);
+        }
+#endif
+    }
+    return err;
+}
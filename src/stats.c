@@ -0,0 +1,143 @@
+#include "stats.h"
+#include "trace.h"
+#include <string.h>
+#include <time.h>
+
+#define SUB_BUCKETS (1u << STATS_SUB_BITS)
+
+static const char *const stage_names[STAT_STAGES] = {
+    [STAT_TRIM] = "trim",
+    [STAT_PARSE] = "parse",
+    [STAT_BUILTIN] = "builtin",
+    [STAT_PATH] = "path",
+    [STAT_FORK] = "fork",
+    [STAT_EXEC] = "exec",
+    [STAT_WAIT] = "wait",
+    [STAT_LINE] = "line",
+};
+
+uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned bucket_of(uint64_t ns)
+{
+    if (ns < SUB_BUCKETS)
+    {
+        return (unsigned)ns;
+    }
+    if (ns >> STATS_MAX_BITS)
+    {
+        ns = ((uint64_t)1 << STATS_MAX_BITS) - 1;
+    }
+    // The top bit picks the power of two, the next STATS_SUB_BITS the bucket in it
+    unsigned e = 63 - (unsigned)__builtin_clzll(ns);
+    return ((e - STATS_SUB_BITS + 1) << STATS_SUB_BITS) | (unsigned)((ns >> (e - STATS_SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+// The largest value that lands in bucket b
+static uint64_t bucket_high(unsigned b)
+{
+    if (b < SUB_BUCKETS)
+    {
+        return b;
+    }
+    unsigned shift = (b >> STATS_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)(SUB_BUCKETS | (b & (SUB_BUCKETS - 1))) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+void stats_add(struct stats_hist *h, uint64_t ns)
+{
+    h->buckets[bucket_of(ns)]++;
+    h->count++;
+    if (ns > h->max)
+    {
+        h->max = ns;
+    }
+}
+
+uint64_t stats_record(struct stats *s, enum stat_stage stage, uint64_t start, const char *what)
+{
+    uint64_t now = stats_now();
+    stats_add(&s->stage[stage], now - start);
+    trace_span(stage_names[stage], what, start, now);
+    return now;
+}
+
+uint64_t stats_percentile(const struct stats_hist *h, double p)
+{
+    if (h->count == 0)
+    {
+        return 0;
+    }
+    // The sample of rank ceil(p% of count), counting from 1
+    double want = p / 100.0 * (double)h->count;
+    uint64_t rank = (uint64_t)want;
+    if ((double)rank < want || rank == 0)
+    {
+        rank++;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < STATS_BUCKETS; b++)
+    {
+        seen += h->buckets[b];
+        if (seen >= rank)
+        {
+            // The last bucket is open ended
+            uint64_t high = b == STATS_BUCKETS - 1 ? h->max : bucket_high(b);
+            return high < h->max ? high : h->max;
+        }
+    }
+    return h->max;
+}
+
+const char *stats_format(char *buf, size_t size, uint64_t ns)
+{
+    if (ns < 1000)
+    {
+        snprintf(buf, size, "%uns", (unsigned)ns);
+    }
+    else if (ns < 1000000)
+    {
+        snprintf(buf, size, "%.1fus", (double)ns / 1e3);
+    }
+    else if (ns < 1000000000)
+    {
+        snprintf(buf, size, "%.1fms", (double)ns / 1e6);
+    }
+    else
+    {
+        snprintf(buf, size, "%.2fs", (double)ns / 1e9);
+    }
+    return buf;
+}
+
+void stats_print(const struct stats *s, FILE *out)
+{
+    char p50[32], p99[32], max[32];
+
+    fprintf(out, "%-8s %10s %10s %10s %10s\n", "stage", "count", "p50", "p99", "max");
+    for (int i = 0; i < STAT_STAGES; i++)
+    {
+        const struct stats_hist *h = &s->stage[i];
+        if (h->count == 0)
+        {
+            fprintf(out, "%-8s %10d %10s %10s %10s\n", stage_names[i], 0, "-", "-", "-");
+            continue;
+        }
+        fprintf(out, "%-8s %10llu %10s %10s %10s\n", stage_names[i], (unsigned long long)h->count,
+                stats_format(p50, sizeof(p50), stats_percentile(h, 50)),
+                stats_format(p99, sizeof(p99), stats_percentile(h, 99)),
+                stats_format(max, sizeof(max), h->max));
+    }
+}
+
+void stats_reset(struct stats *s)
+{
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,121 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Where the time of a command line goes, from the moment the line is
+     * read to the moment the shell is ready for the next one.
+     */
+    enum stat_stage
+    {
+        STAT_TRIM,    // trimming the line
+        STAT_PARSE,   // parse_line
+        STAT_BUILTIN, // looking up and running a built in
+        STAT_PATH,    // resolving a command in PATH
+        STAT_FORK,    // fork() for a child that runs shell code first
+        STAT_EXEC,    // posix_spawn or the fork server, until exec is confirmed
+        STAT_WAIT,    // waiting for a foreground job
+        STAT_LINE,    // the whole line
+        STAT_STAGES,
+    };
+
+#define STATS_SUB_BITS 4 // 16 linear buckets per power of two, within 6.25%
+#define STATS_MAX_BITS 40 // about 18 minutes in ns; longer lands in the last bucket
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+    /**
+     * A log-linear histogram of durations in nanoseconds: values below 16
+     * are counted exactly and every power of two above is split into 16
+     * equal buckets, so any percentile is off by at most 1/16 of the value
+     * while adding a sample is a few shifts and an increment. The maximum
+     * is kept exactly.
+     */
+    struct stats_hist
+    {
+        uint64_t count;
+        uint64_t max;
+        uint32_t buckets[STATS_BUCKETS];
+    };
+
+    /**
+     * One histogram per stage, kept in struct shell and always on. A zeroed
+     * struct stats is empty.
+     */
+    struct stats
+    {
+        struct stats_hist stage[STAT_STAGES];
+    };
+
+    /**
+     * @brief The monotonic clock in nanoseconds.
+     */
+    uint64_t stats_now(void);
+
+    /**
+     * @brief Count one duration.
+     *
+     * @param h The histogram
+     * @param ns The duration in nanoseconds
+     */
+    void stats_add(struct stats_hist *h, uint64_t ns);
+
+    /**
+     * @brief Count the time since start for a stage, and while a trace is
+     * running also write it there as a span. Returns the current time so
+     * that consecutive stages can be chained off one clock read.
+     *
+     * @param s The statistics
+     * @param stage The stage that ran since start
+     * @param start A stats_now timestamp
+     * @param what The command or line it was for, NULL if none
+     * @return The current stats_now time
+     */
+    uint64_t stats_record(struct stats *s, enum stat_stage stage, uint64_t start, const char *what);
+
+    /**
+     * @brief A percentile of a histogram: the upper end of the bucket
+     * holding the sample of that rank, never more than the maximum.
+     *
+     * @param h The histogram
+     * @param p The percentile, between 0 and 100
+     * @return The duration in nanoseconds, 0 for an empty histogram
+     */
+    uint64_t stats_percentile(const struct stats_hist *h, double p);
+
+    /**
+     * @brief Format a duration with a unit that fits, e.g. 850ns, 12.3us,
+     * 4.5ms or 1.25s.
+     *
+     * @param buf Where to write it
+     * @param size The size of buf, 16 is always enough
+     * @param ns The duration in nanoseconds
+     * @return buf
+     */
+    const char *stats_format(char *buf, size_t size, uint64_t ns);
+
+    /**
+     * @brief Print count, p50, p99 and max of every stage.
+     *
+     * @param s The statistics
+     * @param out Where to print
+     */
+    void stats_print(const struct stats *s, FILE *out);
+
+    /**
+     * @brief Forget every sample.
+     *
+     * @param s The statistics
+     */
+    void stats_reset(struct stats *s);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
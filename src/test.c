@@ -0,0 +1,370 @@
+#include "builtin.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ * test expression parser. POSIX fixes the meaning of up to four arguments
+ * by counting them, which is what keeps test -n -a or test ! = ! well
+ * defined; longer expressions go through the usual grammar
+ *
+ *   or      := and { -o and }
+ *   and     := not { -a not }
+ *   not     := ! not | primary
+ *   primary := ( or ) | unary-op word | word binary-op word | word
+ */
+struct test_state
+{
+    const char *name;
+    char **argv;
+    int argc;
+    int pos;
+    bool error;
+};
+
+static void test_error(struct test_state *ts, const char *fmt, const char *arg)
+{
+    if (!ts->error)
+    {
+        fprintf(stderr, "%s: ", ts->name);
+        fprintf(stderr, fmt, arg);
+        fputc('\n', stderr);
+    }
+    ts->error = true;
+}
+
+static bool is_unary(const char *op)
+{
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' && strchr("bcdefghknprsStuwxzGLO", op[1]) != NULL;
+}
+
+static bool is_binary(const char *op)
+{
+    static const char *const ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-gt", "-ge",
+                                      "-lt", "-le", "-nt", "-ot", "-ef", "-a", "-o"};
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        if (strcmp(op, ops[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static intmax_t test_int(struct test_state *ts, const char *arg)
+{
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(arg, &end, 10);
+    while (*end == ' ' || *end == '\t')
+    {
+        end++;
+    }
+    if (end == arg || *end != '\0' || errno == ERANGE)
+    {
+        test_error(ts, "%s: integer expression expected", arg);
+    }
+    return v;
+}
+
+static bool unary(struct test_state *ts, char op, const char *arg)
+{
+    struct stat st;
+
+    switch (op)
+    {
+    case 'n':
+        return arg[0] != '\0';
+    case 'z':
+        return arg[0] == '\0';
+    case 't':
+        return isatty((int)test_int(ts, arg));
+    case 'h':
+    case 'L':
+        return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    case 'r':
+        return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+    case 'w':
+        return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+    case 'x':
+        return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+    }
+
+    if (stat(arg, &st) != 0)
+    {
+        return false;
+    }
+    switch (op)
+    {
+    case 'b':
+        return S_ISBLK(st.st_mode);
+    case 'c':
+        return S_ISCHR(st.st_mode);
+    case 'd':
+        return S_ISDIR(st.st_mode);
+    case 'f':
+        return S_ISREG(st.st_mode);
+    case 'p':
+        return S_ISFIFO(st.st_mode);
+    case 'S':
+        return S_ISSOCK(st.st_mode);
+    case 's':
+        return st.st_size > 0;
+    case 'g':
+        return (st.st_mode & S_ISGID) != 0;
+    case 'u':
+        return (st.st_mode & S_ISUID) != 0;
+    case 'k':
+        return (st.st_mode & S_ISVTX) != 0;
+    case 'O':
+        return st.st_uid == geteuid();
+    case 'G':
+        return st.st_gid == getegid();
+    default: // 'e'
+        return true;
+    }
+}
+
+// Compare modification times, a missing file being older than any other
+static int mtime_cmp(const char *a, const char *b)
+{
+    struct stat sa;
+    struct stat sb;
+    bool ha = stat(a, &sa) == 0;
+    bool hb = stat(b, &sb) == 0;
+    if (!ha || !hb)
+    {
+        return ha - hb;
+    }
+    if (sa.st_mtim.tv_sec != sb.st_mtim.tv_sec)
+    {
+        return sa.st_mtim.tv_sec < sb.st_mtim.tv_sec ? -1 : 1;
+    }
+    return (sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec) - (sa.st_mtim.tv_nsec < sb.st_mtim.tv_nsec);
+}
+
+static bool binary(struct test_state *ts, const char *l, const char *op, const char *r)
+{
+    if (op[0] != '-')
+    {
+        int cmp = strcmp(l, r);
+        switch (op[0])
+        {
+        case '!':
+            return cmp != 0;
+        case '<':
+            return cmp < 0;
+        case '>':
+            return cmp > 0;
+        default:
+            return cmp == 0;
+        }
+    }
+    if (strcmp(op, "-a") == 0)
+    {
+        return l[0] != '\0' && r[0] != '\0';
+    }
+    if (strcmp(op, "-o") == 0)
+    {
+        return l[0] != '\0' || r[0] != '\0';
+    }
+    if (strcmp(op, "-nt") == 0)
+    {
+        return mtime_cmp(l, r) > 0;
+    }
+    if (strcmp(op, "-ot") == 0)
+    {
+        return mtime_cmp(l, r) < 0;
+    }
+    if (strcmp(op, "-ef") == 0)
+    {
+        struct stat sl;
+        struct stat sr;
+        return stat(l, &sl) == 0 && stat(r, &sr) == 0 && sl.st_dev == sr.st_dev && sl.st_ino == sr.st_ino;
+    }
+
+    intmax_t a = test_int(ts, l);
+    intmax_t b = test_int(ts, r);
+    switch (op[1] << 8 | op[2])
+    {
+    case 'e' << 8 | 'q':
+        return a == b;
+    case 'n' << 8 | 'e':
+        return a != b;
+    case 'g' << 8 | 't':
+        return a > b;
+    case 'g' << 8 | 'e':
+        return a >= b;
+    case 'l' << 8 | 't':
+        return a < b;
+    default: // -le
+        return a <= b;
+    }
+}
+
+static bool parse_or(struct test_state *ts);
+
+static const char *peek(struct test_state *ts, int ahead)
+{
+    return ts->pos + ahead < ts->argc ? ts->argv[ts->pos + ahead] : NULL;
+}
+
+static bool parse_primary(struct test_state *ts)
+{
+    const char *word = peek(ts, 0);
+    if (word == NULL)
+    {
+        test_error(ts, "%sargument expected", "");
+        return false;
+    }
+
+    const char *next = peek(ts, 1);
+    // A binary operator wins over a parenthesis or unary operator in front
+    if (next != NULL && peek(ts, 2) != NULL && is_binary(next) && strcmp(next, "-a") != 0 &&
+        strcmp(next, "-o") != 0)
+    {
+        ts->pos += 3;
+        return binary(ts, word, next, ts->argv[ts->pos - 1]);
+    }
+    if (strcmp(word, "(") == 0)
+    {
+        ts->pos++;
+        bool v = parse_or(ts);
+        const char *close = peek(ts, 0);
+        if (close == NULL || strcmp(close, ")") != 0)
+        {
+            test_error(ts, "%s", "')' expected");
+            return false;
+        }
+        ts->pos++;
+        return v;
+    }
+    if (is_unary(word) && next != NULL)
+    {
+        ts->pos += 2;
+        return unary(ts, word[1], next);
+    }
+    ts->pos++;
+    return word[0] != '\0';
+}
+
+static bool parse_not(struct test_state *ts)
+{
+    const char *word = peek(ts, 0);
+    if (word != NULL && strcmp(word, "!") == 0 && peek(ts, 1) != NULL)
+    {
+        ts->pos++;
+        return !parse_not(ts);
+    }
+    return parse_primary(ts);
+}
+
+static bool parse_and(struct test_state *ts)
+{
+    bool v = parse_not(ts);
+    while (peek(ts, 0) != NULL && strcmp(peek(ts, 0), "-a") == 0)
+    {
+        ts->pos++;
+        v = parse_not(ts) && v;
+    }
+    return v;
+}
+
+static bool parse_or(struct test_state *ts)
+{
+    bool v = parse_and(ts);
+    while (peek(ts, 0) != NULL && strcmp(peek(ts, 0), "-o") == 0)
+    {
+        ts->pos++;
+        v = parse_and(ts) || v;
+    }
+    return v;
+}
+
+// The fixed meanings POSIX gives to one to four arguments
+static bool eval_counted(struct test_state *ts, char **a, int n)
+{
+    switch (n)
+    {
+    case 1:
+        return a[0][0] != '\0';
+    case 2:
+        if (strcmp(a[0], "!") == 0)
+        {
+            return a[1][0] == '\0';
+        }
+        if (is_unary(a[0]))
+        {
+            return unary(ts, a[0][1], a[1]);
+        }
+        test_error(ts, "%s: unary operator expected", a[0]);
+        return false;
+    case 3:
+        if (is_binary(a[1]))
+        {
+            return binary(ts, a[0], a[1], a[2]);
+        }
+        if (strcmp(a[0], "!") == 0)
+        {
+            return !eval_counted(ts, a + 1, 2);
+        }
+        if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0)
+        {
+            return a[1][0] != '\0';
+        }
+        test_error(ts, "%s: binary operator expected", a[1]);
+        return false;
+    case 4:
+        if (strcmp(a[0], "!") == 0)
+        {
+            return !eval_counted(ts, a + 1, 3);
+        }
+        if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0)
+        {
+            return eval_counted(ts, a + 1, 2);
+        }
+        // fall through
+    default:
+        ts->pos = 0;
+        bool v = parse_or(ts);
+        if (ts->pos < ts->argc)
+        {
+            test_error(ts, "%s: too many arguments", ts->argv[ts->pos]);
+        }
+        return v;
+    }
+}
+
+int builtin_test(struct shell *sh, char **argv)
+{
+    (void)sh;
+    struct test_state ts = {.name = argv[0], .argv = argv + 1};
+
+    while (ts.argv[ts.argc] != NULL)
+    {
+        ts.argc++;
+    }
+    if (strcmp(argv[0], "[") == 0)
+    {
+        if (ts.argc == 0 || strcmp(ts.argv[ts.argc - 1], "]") != 0)
+        {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        ts.argc--;
+    }
+    if (ts.argc == 0)
+    {
+        return 1;
+    }
+
+    bool v = eval_counted(&ts, ts.argv, ts.argc);
+    if (ts.error)
+    {
+        return 2;
+    }
+    return v ? 0 : 1;
+}
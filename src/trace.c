@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The shell's thread is the only producer and the writer thread the only
+ * consumer, so the ring needs nothing but two counters: the shell fills
+ * slots up to head and publishes them with a release store, the writer
+ * drains them up to tail and hands them back the same way. Neither side
+ * ever waits for the other.
+ *
+ * The writer formats into its own buffer and write(2)s it rather than use
+ * stdio, so a child forked while it holds a lock, and flushing every FILE
+ * before _exit, can neither hang nor write a second copy of the trace.
+ */
+#define TRACE_IDLE_NS 5000000 // how long the writer sleeps on an empty ring
+#define TRACE_BUF 65536
+#define TRACE_EVENT_MAX (TRACE_ARG_MAX * 6 + 256) // escaped, with the fixed fields
+
+static struct
+{
+    struct trace_event *ring;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    atomic_bool stop;
+    bool active; // only the shell's thread reads or writes it
+    long dropped;
+    int fd;
+    pid_t pid;
+    char *path;
+    pthread_t writer;
+    size_t used;
+    char buf[TRACE_BUF];
+} trace;
+
+static void flush_buf(void)
+{
+    for (size_t off = 0; off < trace.used;)
+    {
+        ssize_t n = write(trace.fd, trace.buf + off, trace.used - off);
+        if (n < 0 && errno != EINTR)
+        {
+            break;
+        }
+        off += n > 0 ? (size_t)n : 0;
+    }
+    trace.used = 0;
+}
+
+static void put(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void put(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(trace.buf + trace.used, TRACE_BUF - trace.used, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+    {
+        trace.used += (size_t)n < TRACE_BUF - trace.used ? (size_t)n : TRACE_BUF - trace.used - 1;
+    }
+}
+
+static void put_json_string(const char *s)
+{
+    char *o = trace.buf + trace.used;
+    *o++ = '"';
+    for (; *s != '\0'; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+        {
+            *o++ = '\\';
+            *o++ = (char)c;
+        }
+        else if (c < 0x20)
+        {
+            o += sprintf(o, "\\u%04x", c);
+        }
+        else
+        {
+            *o++ = (char)c;
+        }
+    }
+    *o++ = '"';
+    trace.used = (size_t)(o - trace.buf);
+}
+
+// Chrome trace timestamps are in microseconds
+static void put_event(const struct trace_event *e)
+{
+    if (TRACE_BUF - trace.used < TRACE_EVENT_MAX)
+    {
+        flush_buf();
+    }
+
+    put(",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d", e->name,
+        e->ph == 'X' ? "shell" : "job", e->ph, (double)e->ts / 1e3, (int)trace.pid, (int)trace.pid);
+    if (e->ph == 'X')
+    {
+        put(",\"dur\":%.3f", (double)e->dur / 1e3);
+    }
+    else
+    {
+        put(",\"id\":%d", e->id);
+    }
+    if (e->ph == 'e')
+    {
+        put(",\"args\":{\"status\":%d}}", e->status);
+    }
+    else if (e->arg[0] != '\0')
+    {
+        put(",\"args\":{\"cmd\":");
+        put_json_string(e->arg);
+        put("}}");
+    }
+    else
+    {
+        put("}");
+    }
+}
+
+static void *writer_main(void *unused)
+{
+    (void)unused;
+    for (;;)
+    {
+        // Read before draining: whatever was published before stop gets out
+        bool stopping = atomic_load_explicit(&trace.stop, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&trace.tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&trace.head, memory_order_acquire);
+        for (uint64_t i = tail; i != head; i++)
+        {
+            put_event(&trace.ring[i & (TRACE_RING - 1)]);
+        }
+        atomic_store_explicit(&trace.tail, head, memory_order_release);
+        if (stopping)
+        {
+            return NULL;
+        }
+        if (head == tail)
+        {
+            flush_buf();
+            struct timespec idle = {.tv_nsec = TRACE_IDLE_NS};
+            nanosleep(&idle, NULL);
+        }
+    }
+}
+
+// A forked child has the ring but not the writer
+static void forget_in_child(void)
+{
+    trace.active = false;
+}
+
+// The next free slot, or NULL when not tracing or the ring is full
+static struct trace_event *claim(void)
+{
+    if (!trace.active)
+    {
+        return NULL;
+    }
+    uint64_t head = atomic_load_explicit(&trace.head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&trace.tail, memory_order_acquire) == TRACE_RING)
+    {
+        trace.dropped++;
+        return NULL;
+    }
+    return &trace.ring[head & (TRACE_RING - 1)];
+}
+
+static void publish(void)
+{
+    uint64_t head = atomic_load_explicit(&trace.head, memory_order_relaxed);
+    atomic_store_explicit(&trace.head, head + 1, memory_order_release);
+}
+
+static void set_arg(struct trace_event *e, const char *arg)
+{
+    size_t n = arg != NULL ? strnlen(arg, TRACE_ARG_MAX - 1) : 0;
+    if (n > 0)
+    {
+        memcpy(e->arg, arg, n);
+    }
+    e->arg[n] = '\0';
+}
+
+int trace_start(const char *path)
+{
+    static bool registered;
+
+    if (trace.active)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    trace.ring = malloc(sizeof(struct trace_event) * TRACE_RING);
+    trace.path = strdup(path);
+    if (trace.ring == NULL || trace.path == NULL)
+    {
+        free(trace.ring);
+        free(trace.path);
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    if (!registered)
+    {
+        pthread_atfork(NULL, NULL, forget_in_child);
+        registered = true;
+    }
+
+    trace.fd = fd;
+    trace.pid = getpid();
+    trace.used = 0;
+    trace.dropped = 0;
+    atomic_store(&trace.head, 0);
+    atomic_store(&trace.tail, 0);
+    atomic_store(&trace.stop, false);
+    put("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    put("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"shell\"}}",
+        (int)trace.pid, (int)trace.pid);
+
+    // Signals are for the shell's thread, never the writer
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int err = pthread_create(&trace.writer, NULL, writer_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0)
+    {
+        free(trace.ring);
+        free(trace.path);
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    trace.active = true;
+    return 0;
+}
+
+long trace_stop(void)
+{
+    if (!trace.active)
+    {
+        return -1;
+    }
+    trace.active = false;
+    atomic_store_explicit(&trace.stop, true, memory_order_release);
+    pthread_join(trace.writer, NULL);
+
+    put("\n]}\n");
+    flush_buf();
+    close(trace.fd);
+    free(trace.ring);
+    free(trace.path);
+    trace.ring = NULL;
+    trace.path = NULL;
+    return trace.dropped;
+}
+
+const char *trace_file(void)
+{
+    return trace.active ? trace.path : NULL;
+}
+
+void trace_span(const char *name, const char *arg, uint64_t start, uint64_t end)
+{
+    struct trace_event *e = claim();
+    if (e == NULL)
+    {
+        return;
+    }
+    e->ph = 'X';
+    e->name = name;
+    e->ts = start;
+    e->dur = end - start;
+    set_arg(e, arg);
+    publish();
+}
+
+void trace_job_begin(int id, const char *command)
+{
+    struct trace_event *e = claim();
+    if (e == NULL)
+    {
+        return;
+    }
+    e->ph = 'b';
+    e->name = "job";
+    e->ts = stats_now();
+    e->id = id;
+    set_arg(e, command != NULL ? command : "task");
+    publish();
+}
+
+void trace_job_end(int id, int status)
+{
+    struct trace_event *e = claim();
+    if (e == NULL)
+    {
+        return;
+    }
+    e->ph = 'e';
+    e->name = "job";
+    e->ts = stats_now();
+    e->id = id;
+    e->status = status;
+    e->arg[0] = '\0';
+    publish();
+}
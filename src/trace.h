@@ -0,0 +1,85 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define TRACE_RING 8192 // events in flight, a power of two
+#define TRACE_ARG_MAX 96 // longer command text is cut
+
+    /**
+     * One entry of the trace ring. Names are string literals, so only the
+     * argument text is copied.
+     */
+    struct trace_event
+    {
+        uint64_t ts; // stats_now time
+        uint64_t dur; // for spans
+        const char *name;
+        int id; // for jobs, the pid of the first stage
+        int status; // for the end of a job
+        char ph; // the Chrome trace phase: X, b or e
+        char arg[TRACE_ARG_MAX];
+    };
+
+    /**
+     * @brief Start writing Chrome Trace Event JSON to a file, loadable in
+     * Perfetto or chrome://tracing. Events go into a single producer ring
+     * that a background thread drains to the file, so the shell never
+     * waits on the disk; when the ring is full events are dropped and
+     * counted rather than block. Forked children stop tracing.
+     *
+     * @param path The file, truncated
+     * @return 0, or -1 with errno set (EBUSY if a trace is running)
+     */
+    int trace_start(const char *path);
+
+    /**
+     * @brief Flush every event, close the JSON and the file. Safe to call
+     * when no trace is running.
+     *
+     * @return The number of events that were dropped, or -1 if no trace was
+     * running
+     */
+    long trace_stop(void);
+
+    /**
+     * @brief The file being written, NULL when not tracing.
+     */
+    const char *trace_file(void);
+
+    /**
+     * @brief Record a span of the shell's own work, such as a parse or a
+     * wait. Does nothing when not tracing.
+     *
+     * @param name The kind of span, a string literal
+     * @param arg What it was about, e.g. the command, or NULL
+     * @param start The stats_now time it started
+     * @param end The stats_now time it ended
+     */
+    void trace_span(const char *name, const char *arg, uint64_t start, uint64_t end);
+
+    /**
+     * @brief Open the lifetime of a background job on its own track.
+     *
+     * @param id The pid of its first stage
+     * @param command The command line, or NULL for a built in's task
+     */
+    void trace_job_begin(int id, const char *command);
+
+    /**
+     * @brief Close the lifetime of a background job once it is reaped.
+     *
+     * @param id The id given to trace_job_begin
+     * @param status The exit status of its last stage
+     */
+    void trace_job_end(int id, int status);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#include "usage.h"
+
+static void add_time(struct timeval *sum, const struct timeval *t)
+{
+    sum->tv_sec += t->tv_sec;
+    sum->tv_usec += t->tv_usec;
+    if (sum->tv_usec >= 1000000)
+    {
+        sum->tv_sec++;
+        sum->tv_usec -= 1000000;
+    }
+}
+
+// after - before, for the shell's own times
+static struct timeval diff_time(const struct timeval *after, const struct timeval *before)
+{
+    struct timeval d = {after->tv_sec - before->tv_sec, after->tv_usec - before->tv_usec};
+    if (d.tv_usec < 0)
+    {
+        d.tv_sec--;
+        d.tv_usec += 1000000;
+    }
+    return d;
+}
+
+void usage_add(struct rusage *sum, const struct rusage *r)
+{
+    add_time(&sum->ru_utime, &r->ru_utime);
+    add_time(&sum->ru_stime, &r->ru_stime);
+    if (r->ru_maxrss > sum->ru_maxrss)
+    {
+        sum->ru_maxrss = r->ru_maxrss;
+    }
+    sum->ru_minflt += r->ru_minflt;
+    sum->ru_majflt += r->ru_majflt;
+    sum->ru_nvcsw += r->ru_nvcsw;
+    sum->ru_nivcsw += r->ru_nivcsw;
+}
+
+void usage_add_delta(struct rusage *sum, const struct rusage *after, const struct rusage *before)
+{
+    struct timeval user = diff_time(&after->ru_utime, &before->ru_utime);
+    struct timeval sys = diff_time(&after->ru_stime, &before->ru_stime);
+    add_time(&sum->ru_utime, &user);
+    add_time(&sum->ru_stime, &sys);
+    sum->ru_minflt += after->ru_minflt - before->ru_minflt;
+    sum->ru_majflt += after->ru_majflt - before->ru_majflt;
+    sum->ru_nvcsw += after->ru_nvcsw - before->ru_nvcsw;
+    sum->ru_nivcsw += after->ru_nivcsw - before->ru_nivcsw;
+}
+
+// 1m2.345s, as sh prints times
+static void print_time(FILE *out, const char *name, long sec, long usec)
+{
+    fprintf(out, "%s\t%ldm%ld.%03lds\n", name, sec / 60, sec % 60, usec / 1000);
+}
+
+void usage_print(FILE *out, uint64_t real_ns, const struct rusage *r)
+{
+    print_time(out, "real", (long)(real_ns / 1000000000u), (long)(real_ns % 1000000000u / 1000));
+    print_time(out, "user", (long)r->ru_utime.tv_sec, (long)r->ru_utime.tv_usec);
+    print_time(out, "sys", (long)r->ru_stime.tv_sec, (long)r->ru_stime.tv_usec);
+    fprintf(out, "maxrss\t%ld KB\n", r->ru_maxrss);
+    fprintf(out, "ctxsw\t%ld voluntary, %ld involuntary\n", r->ru_nvcsw, r->ru_nivcsw);
+    fprintf(out, "faults\t%ld minor, %ld major\n", r->ru_minflt, r->ru_majflt);
+}
+
+void usage_print_line(FILE *out, int status, uint64_t real_ns, const struct rusage *r)
+{
+    fprintf(out, "    status %d real %.3fs user %ld.%03lds sys %ld.%03lds maxrss %ld KB ctxsw %ld/%ld faults %ld/%ld\n",
+            status, (double)real_ns / 1e9, (long)r->ru_utime.tv_sec, (long)r->ru_utime.tv_usec / 1000,
+            (long)r->ru_stime.tv_sec, (long)r->ru_stime.tv_usec / 1000, r->ru_maxrss, r->ru_nvcsw, r->ru_nivcsw,
+            r->ru_minflt, r->ru_majflt);
+}
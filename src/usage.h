@@ -0,0 +1,55 @@
+#ifndef USAGE_H
+#define USAGE_H
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Add what one process used to a running total. Times, context
+     * switches and page faults add up; the max RSS is the largest of them.
+     *
+     * @param sum The total
+     * @param r What to add
+     */
+    void usage_add(struct rusage *sum, const struct rusage *r);
+
+    /**
+     * @brief Add what the shell itself used between two getrusage calls,
+     * everything but the max RSS, which is not a difference.
+     *
+     * @param sum The total
+     * @param after RUSAGE_SELF after
+     * @param before RUSAGE_SELF before
+     */
+    void usage_add_delta(struct rusage *sum, const struct rusage *after, const struct rusage *before);
+
+    /**
+     * @brief Print the report of the time keyword: real, user and sys time
+     * like sh, then max RSS, context switches and page faults.
+     *
+     * @param out Where to print
+     * @param real_ns The wall clock time
+     * @param r What was used
+     */
+    void usage_print(FILE *out, uint64_t real_ns, const struct rusage *r);
+
+    /**
+     * @brief Print the same on one line, for jobs -l.
+     *
+     * @param out Where to print
+     * @param status The exit status
+     * @param real_ns The wall clock time
+     * @param r What was used
+     */
+    void usage_print_line(FILE *out, int status, uint64_t real_ns, const struct rusage *r);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,481 @@
+#define _GNU_SOURCE
+#include "lab.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+/*
+ * The fork server. It is forked at the top of sh_init, before readline,
+ * history or the job table exist, so copying it is cheap no matter how big
+ * the shell itself grows. The shell sends it one SOCK_SEQPACKET message per
+ * command with the descriptors the child needs attached as SCM_RIGHTS; it
+ * clones the child with CLONE_PARENT, which makes the child the shell's and
+ * not its own, so waitpid, pidfds, process groups and the terminal work
+ * exactly as if the shell had spawned it.
+ */
+#define ZYGOTE_MAX_FDS 32
+#define ZYGOTE_MSG_MAX 65536
+#define ZYGOTE_FD_BASE 100 // received descriptors are moved up here in the child
+
+enum
+{
+    ZYGOTE_PGROUP = 1,     // put the child in process group pgid
+    ZYGOTE_FOREGROUND = 2, // and give it the terminal
+};
+
+struct zygote_request
+{
+    pid_t pgid;
+    int flags;
+    int in; // index of the pipe ends in the passed descriptors, or -1
+    int out;
+    int n_redirs;
+    int argc;
+    // then n_redirs struct zygote_redir, then cwd, path and argv as strings
+};
+
+struct zygote_redir
+{
+    int type; // enum redir_type
+    int fd;
+    int target; // REDIR_DUP: a passed descriptor if passed, else the child's own
+    bool passed;
+};
+
+struct zygote_reply
+{
+    pid_t pid;
+    int err;
+};
+
+static int zygote_sock = -1;
+static pid_t zygote_server;
+static pid_t zygote_owner;
+
+// The signals an interactive shell ignores; the child gets them back
+static const int zygote_signals[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU};
+
+// In the child: give up on the command, telling the server why
+static void child_fail(int report)
+{
+    int err = errno;
+    while (write(report, &err, sizeof(err)) < 0 && errno == EINTR)
+    {
+    }
+    _exit(127);
+}
+
+static int open_redir(const struct zygote_redir *r, const char *path)
+{
+    switch (r->type)
+    {
+    case REDIR_IN:
+        return open(path, O_RDONLY);
+    case REDIR_OUT:
+        return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    case REDIR_APPEND:
+    case REDIR_APPEND_ERR:
+        return open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    default: // REDIR_OUT_ERR
+        return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+}
+
+/*
+ * In the child: set up the process group, terminal, directory and
+ * descriptors the same way posix_spawn applies its attributes and file
+ * actions, then exec. Never returns.
+ */
+static void child_exec(const struct zygote_request *req, const struct zygote_redir *redirs,
+                       char *strings, int *fds, int n_fds, int report)
+{
+    report = fcntl(report, F_DUPFD_CLOEXEC, ZYGOTE_FD_BASE + ZYGOTE_MAX_FDS);
+    for (int i = 0; i < n_fds; i++)
+    {
+        fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, ZYGOTE_FD_BASE);
+    }
+    if (report < 0)
+    {
+        _exit(127);
+    }
+
+    if (req->flags & ZYGOTE_PGROUP)
+    {
+        setpgid(0, req->pgid);
+        // The terminal is the shell's stdin, passed first; SIGTTOU is still ignored
+        if ((req->flags & ZYGOTE_FOREGROUND) && tcsetpgrp(fds[0], req->pgid == 0 ? getpid() : req->pgid) < 0)
+        {
+            child_fail(report);
+        }
+    }
+    for (size_t i = 0; i < sizeof(zygote_signals) / sizeof(zygote_signals[0]); i++)
+    {
+        signal(zygote_signals[i], SIG_DFL);
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    char *cwd = strings;
+    char *path = cwd + strlen(cwd) + 1;
+    char *argv[req->argc + 1];
+    char *s = path + strlen(path) + 1;
+    for (int i = 0; i < req->argc; i++)
+    {
+        argv[i] = s;
+        s += strlen(s) + 1;
+    }
+    argv[req->argc] = NULL;
+
+    if (chdir(cwd) < 0)
+    {
+        child_fail(report);
+    }
+
+    // The shell's own stdin, stdout and stderr, then the pipe ends
+    for (int i = 0; i < 3; i++)
+    {
+        if (dup2(fds[i], i) < 0)
+        {
+            child_fail(report);
+        }
+    }
+    if ((req->in >= 0 && dup2(fds[req->in], STDIN_FILENO) < 0) ||
+        (req->out >= 0 && dup2(fds[req->out], STDOUT_FILENO) < 0))
+    {
+        child_fail(report);
+    }
+
+    for (int i = 0; i < req->n_redirs; i++)
+    {
+        const struct zygote_redir *r = &redirs[i];
+        if (r->type == REDIR_CLOSE)
+        {
+            close(r->fd);
+            continue;
+        }
+        if (r->type == REDIR_DUP)
+        {
+            if (dup2(r->passed ? fds[r->target] : r->target, r->fd) < 0)
+            {
+                child_fail(report);
+            }
+            continue;
+        }
+
+        int fd = open_redir(r, s);
+        s += strlen(s) + 1;
+        if (fd < 0 || (fd != r->fd && (dup2(fd, r->fd) < 0 || close(fd) < 0)))
+        {
+            child_fail(report);
+        }
+        if ((r->type == REDIR_OUT_ERR || r->type == REDIR_APPEND_ERR) && dup2(r->fd, STDERR_FILENO) < 0)
+        {
+            child_fail(report);
+        }
+    }
+
+    execv(path, argv);
+    child_fail(report);
+}
+
+// Start one command and report its pid, or why it could not be started
+static void serve_request(int sock, char *buf, ssize_t len, int *fds, int n_fds)
+{
+    struct zygote_reply reply = {.pid = -1, .err = EINVAL};
+    struct zygote_request *req = (struct zygote_request *)buf;
+    struct zygote_redir *redirs = (struct zygote_redir *)(req + 1);
+    char *strings = (char *)(redirs + (len >= (ssize_t)sizeof(*req) ? req->n_redirs : 0));
+    int report[2];
+
+    // The message ends in a NUL, so the strings can be walked safely
+    if (len < (ssize_t)sizeof(*req) || n_fds < 3 || req->n_redirs < 0 || req->argc < 1 ||
+        strings >= buf + len || buf[len - 1] != '\0')
+    {
+        // Malformed; refuse it
+    }
+    else if (pipe2(report, O_CLOEXEC) < 0)
+    {
+        reply.err = errno;
+    }
+    else
+    {
+        // Like fork, but the child's parent is the shell
+        pid_t pid = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+        if (pid == 0)
+        {
+            close(sock);
+            close(report[0]);
+            child_exec(req, redirs, strings, fds, n_fds, report[1]);
+        }
+        close(report[1]);
+        reply.pid = pid;
+        reply.err = pid < 0 ? errno : 0;
+        if (pid > 0)
+        {
+            // EOF once the exec succeeded, the errno otherwise
+            ssize_t n;
+            while ((n = read(report[0], &reply.err, sizeof(reply.err))) < 0 && errno == EINTR)
+            {
+            }
+            if (n != sizeof(reply.err))
+            {
+                reply.err = 0;
+            }
+        }
+        close(report[0]);
+    }
+
+    // Drop our copies before answering, so pipes see EOF when they should
+    for (int i = 0; i < n_fds; i++)
+    {
+        close(fds[i]);
+    }
+    send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+static void serve(int sock)
+{
+    static char buf[ZYGOTE_MSG_MAX];
+    union
+    {
+        char space[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+
+    for (;;)
+    {
+        struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf)};
+        struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.space,
+                             .msg_controllen = sizeof(control.space)};
+        ssize_t len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (len <= 0)
+        {
+            // The shell is gone
+            _exit(0);
+        }
+
+        int fds[ZYGOTE_MAX_FDS];
+        int n_fds = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c))
+        {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+            {
+                n_fds = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                memcpy(fds, CMSG_DATA(c), sizeof(int) * (size_t)n_fds);
+            }
+        }
+        serve_request(sock, buf, len, fds, n_fds);
+    }
+}
+
+int zygote_start(void)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // Nothing but the socket; the descriptors come with each request
+        int sock = fcntl(sv[1], F_DUPFD_CLOEXEC, 3);
+        close_range(0, (unsigned)sock - 1, 0);
+        close_range((unsigned)sock + 1, ~0U, 0);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() == 1)
+        {
+            _exit(0);
+        }
+        for (size_t i = 0; i < sizeof(zygote_signals) / sizeof(zygote_signals[0]); i++)
+        {
+            signal(zygote_signals[i], SIG_IGN);
+        }
+        signal(SIGCHLD, SIG_DFL);
+        serve(sock);
+    }
+    close(sv[1]);
+    if (pid < 0)
+    {
+        close(sv[0]);
+        return -1;
+    }
+    zygote_sock = sv[0];
+    zygote_server = pid;
+    zygote_owner = getpid();
+    return pid;
+}
+
+void zygote_stop(void)
+{
+    if (zygote_sock < 0 || zygote_owner != getpid())
+    {
+        return;
+    }
+    close(zygote_sock);
+    zygote_sock = -1;
+    // It exits as soon as it sees the socket close
+    while (waitpid(zygote_server, NULL, 0) < 0 && errno == EINTR)
+    {
+    }
+}
+
+// Append a string to the message, false if it does not fit
+static bool put_string(char *buf, size_t *len, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    if (*len + n > ZYGOTE_MSG_MAX)
+    {
+        return false;
+    }
+    memcpy(buf + *len, s, n);
+    *len += n;
+    return true;
+}
+
+// Whether an earlier redirection of the same command already set up fd
+static bool set_before(const struct redir *first, const struct redir *r, int fd)
+{
+    for (const struct redir *p = first; p != r; p = p->next)
+    {
+        if (p->fd == fd && p->type != REDIR_CLOSE)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int zygote_spawn(struct shell *sh, const char *path, char **argv, pid_t pgid, bool foreground,
+                 const struct spawn_io *io, pid_t *pid)
+{
+    // A forked child of the shell cannot use it: the server's children are the shell's
+    if (zygote_sock < 0 || zygote_owner != getpid())
+    {
+        return -1;
+    }
+
+    static char buf[ZYGOTE_MSG_MAX];
+    struct zygote_request *req = (struct zygote_request *)buf;
+    int fds[ZYGOTE_MAX_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    int n_fds = 3;
+
+    *req = (struct zygote_request){.pgid = pgid, .in = -1, .out = -1};
+    if (sh->shell_is_interactive)
+    {
+        req->flags = ZYGOTE_PGROUP | (foreground ? ZYGOTE_FOREGROUND : 0);
+    }
+    if (io != NULL && io->in >= 0)
+    {
+        req->in = n_fds;
+        fds[n_fds++] = io->in;
+    }
+    if (io != NULL && io->out >= 0)
+    {
+        req->out = n_fds;
+        fds[n_fds++] = io->out;
+    }
+
+    size_t len = sizeof(*req);
+    const struct redir *redirs = io != NULL ? io->redirs : NULL;
+    for (const struct redir *r = redirs; r != NULL; r = r->next)
+    {
+        if (len + sizeof(struct zygote_redir) > ZYGOTE_MSG_MAX || n_fds == ZYGOTE_MAX_FDS)
+        {
+            return -1;
+        }
+        struct zygote_redir *zr = (struct zygote_redir *)(buf + len);
+        *zr = (struct zygote_redir){.type = r->type, .fd = r->fd, .target = r->target_fd};
+        // n>&m takes the shell's m unless the command itself opened m first
+        if (r->type == REDIR_DUP && !set_before(redirs, r, r->target_fd) && fcntl(r->target_fd, F_GETFD) >= 0)
+        {
+            zr->passed = true;
+            zr->target = n_fds;
+            fds[n_fds++] = r->target_fd;
+        }
+        len += sizeof(*zr);
+        req->n_redirs++;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL || !put_string(buf, &len, cwd) || !put_string(buf, &len, path))
+    {
+        return -1;
+    }
+    for (; argv[req->argc] != NULL; req->argc++)
+    {
+        if (!put_string(buf, &len, argv[req->argc]))
+        {
+            return -1;
+        }
+    }
+    for (const struct redir *r = redirs; r != NULL; r = r->next)
+    {
+        if (r->type != REDIR_DUP && r->type != REDIR_CLOSE && !put_string(buf, &len, r->path))
+        {
+            return -1;
+        }
+    }
+
+    union
+    {
+        char space[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.space,
+                         .msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)n_fds)};
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)n_fds);
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * (size_t)n_fds);
+
+    ssize_t n;
+    while ((n = sendmsg(zygote_sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+    {
+    }
+    if (n < 0 && errno != EPIPE && errno != ECONNRESET)
+    {
+        // Say a closed stdin; posix_spawn copes with that, so let it
+        return -1;
+    }
+    struct zygote_reply reply;
+    if (n == (ssize_t)len)
+    {
+        while ((n = recv(zygote_sock, &reply, sizeof(reply), 0)) < 0 && errno == EINTR)
+        {
+        }
+    }
+    if (n != sizeof(reply))
+    {
+        // The server died; stop using it
+        close(zygote_sock);
+        zygote_sock = -1;
+        waitpid(zygote_server, NULL, WNOHANG);
+        return -1;
+    }
+
+    if (reply.err != 0)
+    {
+        // The child already exited and is ours to reap, as posix_spawn would
+        if (reply.pid > 0)
+        {
+            waitpid(reply.pid, NULL, 0);
+        }
+        return reply.err;
+    }
+    *pid = reply.pid;
+    return 0;
+}
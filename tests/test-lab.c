@@ -1,6 +1,16 @@
 #include <string.h>
 #include "harness/unity.h"
 #include "../src/lab.h"
+#include "../src/scan.h"
+#include "../src/input.h"
+#include "../src/pool.h"
+#include "../src/trace.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <time.h>
 
 
 void setUp(void) {
@@ -35,6 +45,34 @@ void test_cmd_parse2(void)
      free(expected[0]);
      free(expected[1]);
      free(expected);
+     cmd_free(actual);
+     free(stng);
+}
+
+void test_cmd_parse_packed(void)
+{
+     const char *line = "\tgrep  -n\tfoo   bar.c \n";
+     char **rval = cmd_parse(line);
+     TEST_ASSERT_TRUE(rval);
+     TEST_ASSERT_EQUAL_STRING("grep", rval[0]);
+     TEST_ASSERT_EQUAL_STRING("-n", rval[1]);
+     TEST_ASSERT_EQUAL_STRING("foo", rval[2]);
+     TEST_ASSERT_EQUAL_STRING("bar.c", rval[3]);
+     TEST_ASSERT_NULL(rval[4]);
+     //Tokens live right behind the pointer array in the same block
+     TEST_ASSERT_EQUAL_PTR((char *)(rval + 5), rval[0]);
+     TEST_ASSERT_EQUAL_PTR(rval[0] + 5, rval[1]);
+     cmd_free(rval);
+}
+
+void test_cmd_parse_only_delims(void)
+{
+     char **rval = cmd_parse(" \t \n ");
+     TEST_ASSERT_TRUE(rval);
+     TEST_ASSERT_NULL(rval[0]);
+     cmd_free(rval);
+     TEST_ASSERT_NULL(cmd_parse(""));
+     TEST_ASSERT_NULL(cmd_parse(NULL));
 }
 
 void test_cmd_parse(void)
@@ -112,6 +150,95 @@ void test_trim_white_mostly_whitespace(void)
      free(line);
 }
 
+// The byte-by-byte implementations the scanner replaced, kept as oracles
+static char *ref_trim_white(char *line)
+{
+     while (isspace((unsigned char)*line))
+          line++;
+     if (*line == 0)
+          return line;
+     char *end = line + strlen(line) - 1;
+     while (end > line && isspace((unsigned char)*end))
+          end--;
+     *(end + 1) = '\0';
+     return line;
+}
+
+static int ref_cmd_parse_matches(const char *line, char **argv)
+{
+     char *copy = strdup(line);
+     int k = 0;
+     int ok = 1;
+     for (char *tok = strtok(copy, " \t\n"); tok; tok = strtok(NULL, " \t\n"))
+     {
+          if (argv[k] == NULL || strcmp(tok, argv[k]) != 0)
+          {
+               ok = 0;
+               break;
+          }
+          k++;
+     }
+     ok = ok && argv[k] == NULL;
+     free(copy);
+     return ok;
+}
+
+static void random_line(char *buf, size_t len, unsigned *seed)
+{
+     static const char pool[] = " \t\n\v\f\rab-=\x80\xff";
+     for (size_t i = 0; i < len; i++)
+     {
+          buf[i] = pool[rand_r(seed) % (sizeof(pool) - 1)];
+     }
+     buf[len] = '\0';
+}
+
+void test_scan_matches_reference(void)
+{
+     const char *impls[] = {"scalar", "sse2", "avx2"};
+     const char *saved = scan_impl_name();
+     char buf[300];
+     char copy[300];
+
+     for (size_t m = 0; m < sizeof(impls) / sizeof(impls[0]); m++)
+     {
+          if (scan_set_impl(impls[m]) != 0)
+               continue;
+          unsigned seed = 42;
+          for (int iter = 0; iter < 2000; iter++)
+          {
+               size_t len = 1 + (size_t)(rand_r(&seed) % 200);
+               random_line(buf, len, &seed);
+               strcpy(copy, buf);
+               TEST_ASSERT_EQUAL_STRING(ref_trim_white(copy), trim_white(buf));
+
+               random_line(buf, len, &seed);
+               char **argv = cmd_parse(buf);
+               TEST_ASSERT_TRUE_MESSAGE(ref_cmd_parse_matches(buf, argv), impls[m]);
+               cmd_free(argv);
+
+               for (size_t i = 0; i < len; i++)
+                    buf[i] = "abcdefgh;&|<>'\"\\# \t\n"[rand_r(&seed) % 20];
+               TEST_ASSERT_EQUAL_size_t(strcspn(buf, ";&|<>'\"\\# \t\n"), scan_cspan(buf, len, SCAN_META));
+          }
+     }
+     TEST_ASSERT_EQUAL_INT(0, scan_set_impl(saved));
+}
+
+void test_scan_long_runs(void)
+{
+     char buf[200];
+     memset(buf, ' ', 100);
+     memset(buf + 100, 'x', 99);
+     buf[199] = '\0';
+     TEST_ASSERT_EQUAL_size_t(100, scan_span(buf, 199, SCAN_SPACE));
+     TEST_ASSERT_EQUAL_size_t(0, scan_cspan(buf, 199, SCAN_DELIM));
+     TEST_ASSERT_EQUAL_size_t(99, scan_cspan(buf + 100, 99, SCAN_DELIM));
+     TEST_ASSERT_EQUAL_size_t(100, scan_rspan(buf, 100, SCAN_SPACE));
+     TEST_ASSERT_EQUAL_size_t(0, scan_rspan(buf, 199, SCAN_SPACE));
+     TEST_ASSERT_EQUAL_size_t(0, scan_span(buf, 0, SCAN_SPACE));
+}
+
 void test_get_prompt_default(void)
 {
      char *prompt = get_prompt("MY_PROMPT");
@@ -159,20 +286,1469 @@ void test_ch_dir_root(void)
      cmd_free(cmd);
 }
 
+void test_parse_quotes_and_escapes(void)
+{
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "echo 'a  b' \"c \\\"d\\\"\" e\\ f g#h", &n));
+     TEST_ASSERT_EQUAL_INT(NODE_COMMAND, n->type);
+     TEST_ASSERT_EQUAL_INT(5, n->cmd.argc);
+     TEST_ASSERT_EQUAL_STRING("echo", n->cmd.argv[0]);
+     TEST_ASSERT_EQUAL_STRING("a  b", n->cmd.argv[1]);
+     TEST_ASSERT_EQUAL_STRING("c \"d\"", n->cmd.argv[2]);
+     TEST_ASSERT_EQUAL_STRING("e f", n->cmd.argv[3]);
+     TEST_ASSERT_EQUAL_STRING("g#h", n->cmd.argv[4]);
+     TEST_ASSERT_NULL(n->cmd.argv[5]);
+     arena_destroy(&a);
+}
+
+void test_parse_lists(void)
+{
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "a && b || c; d & e", &n));
+     TEST_ASSERT_EQUAL_INT(NODE_SEQUENCE, n->type);
+     TEST_ASSERT_EQUAL_INT(NODE_COMMAND, n->pair.right->type);
+     TEST_ASSERT_EQUAL_STRING("e", n->pair.right->cmd.argv[0]);
+     struct node *left = n->pair.left;
+     TEST_ASSERT_EQUAL_INT(NODE_SEQUENCE, left->type);
+     TEST_ASSERT_EQUAL_INT(NODE_OR, left->pair.left->type);
+     TEST_ASSERT_EQUAL_INT(NODE_AND, left->pair.left->pair.left->type);
+     TEST_ASSERT_EQUAL_INT(NODE_BACKGROUND, left->pair.right->type);
+     TEST_ASSERT_EQUAL_STRING("d", left->pair.right->child->cmd.argv[0]);
+     arena_destroy(&a);
+}
+
+void test_parse_pipeline_and_redirects(void)
+{
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "sort < in 2>&1 | uniq -c >> out 2>err", &n));
+     TEST_ASSERT_EQUAL_INT(NODE_PIPELINE, n->type);
+     TEST_ASSERT_EQUAL_INT(2, n->pipe.n);
+     struct redir *r = n->pipe.stages[0]->cmd.redirs;
+     TEST_ASSERT_EQUAL_INT(REDIR_IN, r->type);
+     TEST_ASSERT_EQUAL_INT(0, r->fd);
+     TEST_ASSERT_EQUAL_STRING("in", r->path);
+     TEST_ASSERT_EQUAL_INT(REDIR_DUP, r->next->type);
+     TEST_ASSERT_EQUAL_INT(2, r->next->fd);
+     TEST_ASSERT_EQUAL_INT(1, r->next->target_fd);
+     struct node *uniq = n->pipe.stages[1];
+     TEST_ASSERT_EQUAL_INT(2, uniq->cmd.argc);
+     TEST_ASSERT_EQUAL_INT(REDIR_APPEND, uniq->cmd.redirs->type);
+     TEST_ASSERT_EQUAL_INT(REDIR_OUT, uniq->cmd.redirs->next->type);
+     TEST_ASSERT_EQUAL_INT(2, uniq->cmd.redirs->next->fd);
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "make &> log", &n));
+     TEST_ASSERT_EQUAL_INT(REDIR_OUT_ERR, n->cmd.redirs->type);
+     arena_destroy(&a);
+}
+
+void test_parse_errors_and_blank(void)
+{
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+     TEST_ASSERT_EQUAL_INT(-1, parse_line(&a, "a ;; b", &n));
+     TEST_ASSERT_EQUAL_INT(-1, parse_line(&a, "a &&", &n));
+     TEST_ASSERT_EQUAL_INT(-1, parse_line(&a, "| a", &n));
+     TEST_ASSERT_EQUAL_INT(-1, parse_line(&a, "echo 'oops", &n));
+     TEST_ASSERT_EQUAL_INT(-1, parse_line(&a, "cat <", &n));
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "   # just a comment", &n));
+     TEST_ASSERT_NULL(n);
+     arena_destroy(&a);
+}
+
+void test_arena_reset_reuses_chunks(void)
+{
+     struct arena a;
+     arena_init(&a, 256);
+     char *first = arena_alloc(&a, 100);
+     for (int i = 0; i < 20; i++)
+     {
+          TEST_ASSERT_NOT_NULL(arena_alloc(&a, 100));
+     }
+     struct arena_chunk *head = a.head;
+     arena_reset(&a);
+     TEST_ASSERT_EQUAL_PTR(first, arena_alloc(&a, 100));
+     TEST_ASSERT_EQUAL_PTR(head, a.head);
+     TEST_ASSERT_NOT_NULL(arena_alloc(&a, 4096));
+     arena_destroy(&a);
+}
+
+void test_arena_alignment(void)
+{
+     struct arena a;
+     arena_init(&a, 256);
+     struct pool p = {0};
+     //Odd sizes, and enough of them to start new chunks and slabs
+     for (size_t i = 1; i < 200; i++)
+     {
+          void *x = arena_alloc(&a, i % 37);
+          TEST_ASSERT_EQUAL_UINT(0, (uintptr_t)x % alignof(max_align_t));
+          void *y = pool_alloc(&p, i);
+          TEST_ASSERT_EQUAL_UINT(0, (uintptr_t)y % alignof(max_align_t));
+     }
+     arena_destroy(&a);
+     pool_destroy(&p);
+}
+
+void test_spawn_process(void)
+{
+     struct shell sh = {0};
+     char *ok[] = {"true", NULL};
+     char *missing[] = {"no-such-command-xyz", NULL};
+     pid_t pid;
+     int status;
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/true", ok, 0, false, NULL, &pid));
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+     TEST_ASSERT_TRUE(WIFEXITED(status));
+     TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+     TEST_ASSERT_EQUAL_INT(ENOENT, spawn_process(&sh, missing[0], missing, 0, false, NULL, &pid));
+}
+
+void test_execute_status(void)
+{
+     struct shell sh = {0};
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+     TEST_ASSERT_TRUE(zygote_start() > 0);
+     enum spawn_mode modes[] = {SPAWN_POSIX, SPAWN_FORK, SPAWN_ZYGOTE};
+     for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+     {
+          sh.spawn_mode = modes[i];
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "true && false", &n));
+          TEST_ASSERT_EQUAL_INT(1, execute(&sh, n));
+          TEST_ASSERT_EQUAL_INT(1, sh.last_status);
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "false || true", &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "no-such-command-xyz 2>/dev/null", &n));
+          TEST_ASSERT_EQUAL_INT(127, execute(&sh, n));
+          arena_reset(&a);
+     }
+     zygote_stop();
+     arena_destroy(&a);
+     sh_destroy(&sh);
+}
+
+void test_pipeline_status_and_data(void)
+{
+     struct shell sh = {0};
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+     char out[] = "/tmp/test-lab-pipeXXXXXX";
+     int fd = mkstemp(out);
+     TEST_ASSERT_TRUE(fd >= 0);
+     close(fd);
+     char line[128];
+
+     TEST_ASSERT_TRUE(zygote_start() > 0);
+     enum spawn_mode modes[] = {SPAWN_POSIX, SPAWN_FORK, SPAWN_ZYGOTE};
+     for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+     {
+          sh.spawn_mode = modes[i];
+          //The status of a pipeline is the status of its last stage
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "false | true", &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "true | false", &n));
+          TEST_ASSERT_EQUAL_INT(1, execute(&sh, n));
+
+          snprintf(line, sizeof(line), "printf 'c\\nb\\na\\n' | sort | head -n 1 > %s", out);
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+          FILE *f = fopen(out, "r");
+          TEST_ASSERT_NOT_NULL(f);
+          TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+          TEST_ASSERT_EQUAL_STRING("a\n", line);
+          fclose(f);
+          arena_reset(&a);
+     }
+     zygote_stop();
+     unlink(out);
+     arena_destroy(&a);
+     sh_destroy(&sh);
+}
+
+void test_redirections_spawned(void)
+{
+     struct shell sh = {0};
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+     char out[] = "/tmp/test-lab-redirXXXXXX";
+     int fd = mkstemp(out);
+     TEST_ASSERT_TRUE(fd >= 0);
+     close(fd);
+     char line[256];
+
+     TEST_ASSERT_TRUE(zygote_start() > 0);
+     enum spawn_mode modes[] = {SPAWN_POSIX, SPAWN_FORK, SPAWN_ZYGOTE};
+     for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+     {
+          sh.spawn_mode = modes[i];
+          //Truncate, append, then read the file back through stdin
+          snprintf(line, sizeof(line), "printf 'a\\n' > %s", out);
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+          snprintf(line, sizeof(line), "sh -c 'echo b; echo c >&2' >> %s 2>&1", out);
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+          snprintf(line, sizeof(line), "grep -c . < %s", out);
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+          snprintf(line, sizeof(line), "grep -qx c %s", out);
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+
+          //&> sends both streams to a fresh file, 2> only stderr
+          snprintf(line, sizeof(line), "sh -c 'echo o; echo e >&2; exit 3' &> %s", out);
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+          TEST_ASSERT_EQUAL_INT(3, execute(&sh, n));
+          FILE *f = fopen(out, "r");
+          TEST_ASSERT_NOT_NULL(f);
+          TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+          TEST_ASSERT_EQUAL_STRING("o\n", line);
+          TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+          TEST_ASSERT_EQUAL_STRING("e\n", line);
+          fclose(f);
+          snprintf(line, sizeof(line), "sh -c 'echo e >&2' 2> %s", out);
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+          f = fopen(out, "r");
+          TEST_ASSERT_NOT_NULL(f);
+          TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+          TEST_ASSERT_EQUAL_STRING("e\n", line);
+          fclose(f);
+
+          //A redirection that can't be opened fails the command
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "cat < /nonexistent/test-lab 2> /dev/null", &n));
+          TEST_ASSERT_EQUAL_INT(1, execute(&sh, n));
+          arena_reset(&a);
+     }
+     zygote_stop();
+     unlink(out);
+     arena_destroy(&a);
+     sh_destroy(&sh);
+}
+
+void test_zygote_spawn(void)
+{
+     struct shell sh = {.spawn_mode = SPAWN_ZYGOTE};
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+     char out[] = "/tmp/test-lab-zygoteXXXXXX";
+     int fd = mkstemp(out);
+     TEST_ASSERT_TRUE(fd >= 0);
+     close(fd);
+     char line[256];
+     char cwd[PATH_MAX];
+     TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+
+     pid_t server = zygote_start();
+     TEST_ASSERT_TRUE(server > 0);
+
+     //The child is ours, not the server's, and runs in our current directory
+     TEST_ASSERT_EQUAL_INT(0, chdir("/"));
+     snprintf(line, sizeof(line), "sh -c 'echo $PPID; pwd' | cat > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+     TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     FILE *f = fopen(out, "r");
+     TEST_ASSERT_NOT_NULL(f);
+     TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+     TEST_ASSERT_EQUAL_INT(getpid(), atoi(line));
+     TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));
+     TEST_ASSERT_EQUAL_STRING("/\n", line);
+     fclose(f);
+
+     //Exec failures come back as errors, and the server is still there
+     char *argv[] = {"/nonexistent/test-lab", NULL};
+     pid_t pid;
+     TEST_ASSERT_EQUAL_INT(ENOENT, zygote_spawn(&sh, argv[0], argv, 0, false, NULL, &pid));
+     TEST_ASSERT_EQUAL_INT(0, zygote_spawn(&sh, "/bin/true", argv, 0, false, NULL, &pid));
+     int status;
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+     TEST_ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+     //Without a server the caller spawns directly
+     zygote_stop();
+     TEST_ASSERT_EQUAL_INT(-1, zygote_spawn(&sh, "/bin/true", argv, 0, false, NULL, &pid));
+     TEST_ASSERT_EQUAL_INT(-1, kill(server, 0));
+     unlink(out);
+     arena_destroy(&a);
+     sh_destroy(&sh);
+}
+
+void test_path_cache(void)
+{
+     struct path_cache pc = {0};
+     char *saved = strdup(getenv("PATH"));
+     setenv("PATH", "/nonexistent:/bin:/usr/bin", 1);
+
+     const char *sh = path_lookup(&pc, "sh", true);
+     TEST_ASSERT_EQUAL_STRING("/bin/sh", sh);
+     TEST_ASSERT_EQUAL_PTR(sh, path_lookup(&pc, "sh", true));
+     TEST_ASSERT_NULL(path_lookup(&pc, "no-such-command-xyz", true));
+     TEST_ASSERT_EQUAL_STRING("./local", path_lookup(&pc, "./local", true));
+
+     //Enough names to force the table to grow, then remove every other one
+     const char *names[] = {"ls", "cat", "cp", "mv", "rm", "ln", "mkdir", "rmdir",
+                            "touch", "chmod", "date", "echo", "true", "false",
+                            "sleep", "grep", "sed", "sort", "uniq", "wc", "head",
+                            "tail", "tr", "cut", "env", "id", "uname", "kill",
+                            "ps", "find", "xargs", "tee", "dd", "df", "du"};
+     size_t n = sizeof(names) / sizeof(names[0]);
+     const char *found[sizeof(names) / sizeof(names[0])];
+     for (size_t i = 0; i < n; i++)
+     {
+          found[i] = path_lookup(&pc, names[i], false);
+          TEST_ASSERT_NOT_NULL_MESSAGE(found[i], names[i]);
+     }
+     TEST_ASSERT_EQUAL_size_t(n + 1, pc.count);
+     TEST_ASSERT_EQUAL_size_t(128, pc.cap);
+     for (size_t i = 0; i < n; i += 2)
+     {
+          path_forget(&pc, names[i]);
+     }
+     for (size_t i = 1; i < n; i += 2)
+     {
+          //Still cached: the same string comes back without a new search
+          TEST_ASSERT_EQUAL_PTR(found[i], path_lookup(&pc, names[i], false));
+     }
+     TEST_ASSERT_EQUAL_size_t(n + 1 - (n + 1) / 2, pc.count);
+
+     //Reassigning PATH drops the table
+     setenv("PATH", "/usr/bin", 1);
+     TEST_ASSERT_EQUAL_STRING("/usr/bin/ls", path_lookup(&pc, "ls", false));
+     TEST_ASSERT_EQUAL_size_t(1, pc.count);
+
+     setenv("PATH", saved, 1);
+     free(saved);
+     path_destroy(&pc);
+}
+
+// A #!/bin/sh script that exits with 0, at dir/name
+static void write_script(const char *dir, const char *name)
+{
+     char path[256];
+     snprintf(path, sizeof(path), "%s/%s", dir, name);
+     FILE *f = fopen(path, "w");
+     TEST_ASSERT_NOT_NULL(f);
+     fputs("#!/bin/sh\nexit 0\n", f);
+     fclose(f);
+     chmod(path, 0755);
+}
+
+void test_path_cache_heals(void)
+{
+     struct shell sh = {0};
+     char a[] = "/tmp/test-lab-a-XXXXXX";
+     char b[] = "/tmp/test-lab-b-XXXXXX";
+     TEST_ASSERT_NOT_NULL(mkdtemp(a));
+     TEST_ASSERT_NOT_NULL(mkdtemp(b));
+     char *saved = strdup(getenv("PATH"));
+     char path[512];
+     snprintf(path, sizeof(path), "%s:%s:/bin:/usr/bin", a, b);
+     setenv("PATH", path, 1);
+
+     char in_a[256], in_b[256];
+     snprintf(in_a, sizeof(in_a), "%s/heal-xyz", a);
+     snprintf(in_b, sizeof(in_b), "%s/heal-xyz", b);
+     write_script(a, "heal-xyz");
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "heal-xyz | cat", false));
+     TEST_ASSERT_EQUAL_STRING(in_a, path_lookup(&sh.paths, "heal-xyz", false));
+
+     //A pipeline stage relearns a command that moved
+     unlink(in_a);
+     write_script(b, "heal-xyz");
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "heal-xyz | cat", false));
+     TEST_ASSERT_EQUAL_STRING(in_b, path_lookup(&sh.paths, "heal-xyz", false));
+
+     //So does a command with a redirection
+     unlink(in_b);
+     write_script(a, "heal-xyz");
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "heal-xyz > /dev/null", false));
+     TEST_ASSERT_EQUAL_STRING(in_a, path_lookup(&sh.paths, "heal-xyz", false));
+
+     unlink(in_a);
+     rmdir(a);
+     rmdir(b);
+     setenv("PATH", saved, 1);
+     free(saved);
+     sh_destroy(&sh);
+}
+
+void test_jobs_reaped_on_sigchld(void)
+{
+     struct shell sh = {0};
+     char *argv[] = {"true", NULL};
+     pid_t pid;
+
+     jobs_init();
+     TEST_ASSERT_EQUAL_INT(0, check_jobs());
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/true", argv, 0, false, NULL, &pid));
+     add_job(pid, argv);
+
+     //The event descriptor wakes up without anyone polling the job
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     int ready;
+     while ((ready = poll(&p, 1, 5000)) < 0 && errno == EINTR)
+          ;
+     TEST_ASSERT_EQUAL_INT(1, ready);
+     TEST_ASSERT_EQUAL_INT(1, check_jobs());
+     TEST_ASSERT_EQUAL_INT(0, check_jobs());
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(pid, NULL, WNOHANG));
+}
+
+void test_jobs_stress(void)
+{
+     struct shell sh = {0};
+     char *argv[] = {"true", NULL};
+     const int n = 5000;
+     int accepted = 0;
+     int done = 0;
+
+     jobs_init();
+     check_jobs();
+
+     //Keep the Running/Done lines out of the test output
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     int null = open("/dev/null", O_WRONLY);
+     dup2(null, STDOUT_FILENO);
+     close(null);
+
+     for (int i = 0; i < n; i++)
+     {
+          pid_t pid;
+          TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/true", argv, 0, false, NULL, &pid));
+          accepted += add_job(pid, argv) == 0;
+          if (i % 64 == 0)
+          {
+               done += check_jobs();
+          }
+     }
+
+     //Every job finishes and is reported exactly once, and the children
+     //the table had no room for are reaped as well
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     siginfo_t info;
+     while (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+     {
+          int ready;
+          while ((ready = poll(&p, 1, 5000)) < 0 && errno == EINTR)
+               ;
+          TEST_ASSERT_EQUAL_INT(1, ready);
+          done += check_jobs();
+     }
+     TEST_ASSERT_EQUAL_INT(ECHILD, errno);
+
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+
+     TEST_ASSERT_EQUAL_INT(n, accepted);
+     TEST_ASSERT_EQUAL_INT(accepted, done);
+}
+
+void test_jobs_out_of_descriptors(void)
+{
+     struct shell sh = {0};
+     char *argv[] = {"sleep", "0.2", NULL};
+     const int n = 24;
+
+     jobs_init();
+     check_jobs();
+     struct rlimit saved_limit;
+     getrlimit(RLIMIT_NOFILE, &saved_limit);
+     int top = 0;
+     for (int fd = 0; fd < 4096; fd++)
+     {
+          if (fcntl(fd, F_GETFD) >= 0)
+          {
+               top = fd;
+          }
+     }
+     //Room for a few pidfds, not for all the jobs
+     struct rlimit low = {.rlim_cur = (rlim_t)top + 5, .rlim_max = saved_limit.rlim_max};
+     TEST_ASSERT_EQUAL_INT(0, setrlimit(RLIMIT_NOFILE, &low));
+
+     //Setting up the jobs leaves the limit the commands inherit alone
+     fflush(stdout);
+     pid_t child = fork();
+     if (child == 0)
+     {
+          jobs_init();
+          struct rlimit now;
+          getrlimit(RLIMIT_NOFILE, &now);
+          _exit(now.rlim_cur == low.rlim_cur ? 0 : 1);
+     }
+     int status;
+     TEST_ASSERT_EQUAL_INT(child, waitpid(child, &status, 0));
+     TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+
+     int saved = dup(STDOUT_FILENO);
+     int null = open("/dev/null", O_WRONLY);
+     dup2(null, STDOUT_FILENO);
+     close(null);
+
+     int accepted = 0;
+     int done = 0;
+     for (int i = 0; i < n; i++)
+     {
+          pid_t pid;
+          TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/sleep", argv, 0, false, NULL, &pid));
+          accepted += add_job(pid, argv) == 0;
+     }
+
+     //The jobs without a pidfd are reaped when SIGCHLD says so
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     siginfo_t info;
+     while (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+     {
+          int ready;
+          while ((ready = poll(&p, 1, 5000)) < 0 && errno == EINTR)
+               ;
+          TEST_ASSERT_EQUAL_INT(1, ready);
+          done += check_jobs();
+     }
+     TEST_ASSERT_EQUAL_INT(ECHILD, errno);
+
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+     setrlimit(RLIMIT_NOFILE, &saved_limit);
+
+     TEST_ASSERT_EQUAL_INT(n, accepted);
+     TEST_ASSERT_EQUAL_INT(n, done);
+}
+
+void test_jobs_reuse_ids(void)
+{
+     struct shell sh = {0};
+     char *sleep_argv[] = {"sleep", "10", NULL};
+     char *true_argv[] = {"true", NULL};
+     pid_t pids[3];
+
+     jobs_init();
+     check_jobs();
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     int null = open("/dev/null", O_WRONLY);
+     dup2(null, STDOUT_FILENO);
+     close(null);
+
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/sleep", sleep_argv, 0, false, NULL, &pids[0]));
+     TEST_ASSERT_EQUAL_INT(0, add_job(pids[0], sleep_argv));
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/true", true_argv, 0, false, NULL, &pids[1]));
+     TEST_ASSERT_EQUAL_INT(0, add_job(pids[1], true_argv));
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/sleep", sleep_argv, 0, false, NULL, &pids[2]));
+     TEST_ASSERT_EQUAL_INT(0, add_job(pids[2], sleep_argv));
+     TEST_ASSERT_EQUAL_INT(1, job_find(pids[0])->job_id);
+     TEST_ASSERT_EQUAL_INT(2, job_find(pids[1])->job_id);
+     TEST_ASSERT_EQUAL_INT(3, job_find(pids[2])->job_id);
+
+     //Once job 2 has been reported its id is the lowest free one again
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     while (check_jobs() == 0)
+     {
+          while (poll(&p, 1, 5000) < 0 && errno == EINTR)
+               ;
+     }
+     TEST_ASSERT_NULL(job_find(pids[1]));
+     pid_t pid;
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/sleep", sleep_argv, 0, false, NULL, &pid));
+     TEST_ASSERT_EQUAL_INT(0, add_job(pid, sleep_argv));
+     TEST_ASSERT_EQUAL_INT(2, job_find(pid)->job_id);
+     pids[1] = pid;
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/true", true_argv, 0, false, NULL, &pid));
+     TEST_ASSERT_EQUAL_INT(0, add_job(pid, true_argv));
+     TEST_ASSERT_EQUAL_INT(4, job_find(pid)->job_id);
+
+     for (int i = 0; i < 3; i++)
+     {
+          kill(pids[i], SIGKILL);
+     }
+     int done = 0;
+     while (done < 4)
+     {
+          while (poll(&p, 1, 5000) < 0 && errno == EINTR)
+               ;
+          done += check_jobs();
+     }
+
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+}
+
+void test_jobs_maxjobs_queue(void)
+{
+     struct shell sh = {0};
+     struct arena a;
+     arena_init(&a, 0);
+     struct node *n;
+
+     jobs_init();
+     check_jobs();
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     int null = open("/dev/null", O_WRONLY);
+     dup2(null, STDOUT_FILENO);
+     close(null);
+
+     //Two run at a time, the rest wait in order, each keeping its own tree
+     jobs_set_limit(2);
+     TEST_ASSERT_EQUAL_INT(2, jobs_limit());
+     struct timespec start, end;
+     clock_gettime(CLOCK_MONOTONIC, &start);
+     for (int i = 0; i < 5; i++)
+     {
+          TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "sleep 0.2 &", &n));
+          TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+          arena_reset(&a);
+     }
+     TEST_ASSERT_EQUAL_INT(3, jobs_pending());
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&a, "nosuchcommand-test-lab &", &n));
+     TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+     TEST_ASSERT_EQUAL_INT(4, jobs_pending());
+     arena_reset(&a);
+
+     //The fifth job can only start once two rounds have finished
+     jobs_wait_pending();
+     clock_gettime(CLOCK_MONOTONIC, &end);
+     TEST_ASSERT_EQUAL_INT(0, jobs_pending());
+     double waited = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+     TEST_ASSERT_TRUE(waited >= 0.4);
+
+     //Waiting already reported some; reap the rest without stealing them
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     siginfo_t info;
+     while (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+     {
+          while (poll(&p, 1, 5000) < 0 && errno == EINTR)
+               ;
+          check_jobs();
+     }
+     check_jobs();
+     jobs_set_limit(0);
+
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+     arena_destroy(&a);
+     sh_destroy(&sh);
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+}
+
+void test_pipeline_job_stages(void)
+{
+     struct shell sh = {0};
+     char *sh_argv[] = {"sh", "-c", "exit 3", NULL};
+     char *true_argv[] = {"true", NULL};
+     pid_t pids[2];
+
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     int null = open("/dev/null", O_WRONLY);
+     dup2(null, STDOUT_FILENO);
+     close(null);
+
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/sh", sh_argv, 0, false, NULL, &pids[0]));
+     TEST_ASSERT_EQUAL_INT(0, spawn_process(&sh, "/bin/true", true_argv, 0, false, NULL, &pids[1]));
+     TEST_ASSERT_EQUAL_INT(0, add_pipeline_job(pids, 2, sh_argv));
+
+     //Both stages belong to the same job, which finishes once
+     struct job *j = job_find(pids[0]);
+     TEST_ASSERT_EQUAL_PTR(j, job_find(pids[1]));
+     TEST_ASSERT_EQUAL_INT(2, j->n_stages);
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     int done = 0;
+     while (done == 0)
+     {
+          while (poll(&p, 1, 5000) < 0 && errno == EINTR)
+               ;
+          done = jobs_reap();
+     }
+     TEST_ASSERT_EQUAL_INT(1, done);
+     TEST_ASSERT_TRUE(j->stages[0].done && j->stages[1].done);
+     TEST_ASSERT_EQUAL_INT(3, j->stages[0].status);
+     TEST_ASSERT_EQUAL_INT(0, j->stages[1].status);
+     TEST_ASSERT_EQUAL_INT(1, check_jobs());
+
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+}
+
+void test_jobs_full_command(void)
+{
+     struct shell sh = {0};
+     struct node *n;
+
+     jobs_init();
+     check_jobs();
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     FILE *out = tmpfile();
+     dup2(fileno(out), STDOUT_FILENO);
+
+     //The listing shows the whole line, quoted so it could be run again
+     jobs_set_limit(1);
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&sh.mem, "sleep 0.1 | cat > /dev/null &", &n));
+     TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&sh.mem, "echo 'a b' \"it's\" 2>&1 >> /dev/null && true &", &n));
+     TEST_ASSERT_EQUAL_INT(0, execute(&sh, n));
+     arena_reset(&sh.mem);
+     show_jobs();
+     jobs_wait_pending();
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     siginfo_t info;
+     while (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+     {
+          while (poll(&p, 1, 5000) < 0 && errno == EINTR)
+               ;
+          check_jobs();
+     }
+     check_jobs();
+     jobs_set_limit(0);
+
+     //Thousands of jobs later the pool has handed the same blocks back
+     struct pool pool = {0};
+     void *first = pool_alloc(&pool, sizeof("sleep 1 | cat"));
+     pool_free(&pool, first, sizeof("sleep 1 | cat"));
+     for (int i = 0; i < 10000; i++)
+     {
+          char *text = pool_strdup(&pool, "sleep 1 | cat");
+          TEST_ASSERT_EQUAL_PTR(first, text);
+          pool_free(&pool, text, strlen(text) + 1);
+     }
+     void *big = pool_alloc(&pool, 5000);
+     TEST_ASSERT_NOT_NULL(big);
+     pool_free(&pool, big, 5000);
+     pool_destroy(&pool);
+
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+     char buf[1024];
+     rewind(out);
+     size_t len = fread(buf, 1, sizeof(buf) - 1, out);
+     buf[len] = '\0';
+     fclose(out);
+     sh_destroy(&sh);
+     TEST_ASSERT_NOT_NULL(strstr(buf, "Running sleep 0.1 | cat > /dev/null &\n"));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "Pending echo 'a b' 'it'\\''s' 2>&1 >> /dev/null && true &\n"));
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+}
+
+void test_reader_lines(void)
+{
+     //A line longer than the first block forces the buffer to grow
+     size_t long_len = 100000;
+     char *long_line = malloc(long_len + 1);
+     memset(long_line, 'x', long_len);
+     long_line[long_len] = '\0';
+
+     FILE *f = tmpfile();
+     fprintf(f, "ls -l\n\n  cd /tmp \n%s\nlast", long_line);
+     rewind(f);
+
+     struct line_reader r;
+     reader_init(&r, fileno(f));
+     size_t len;
+     TEST_ASSERT_EQUAL_STRING("ls -l", reader_line(&r, &len));
+     TEST_ASSERT_EQUAL_size_t(5, len);
+     TEST_ASSERT_EQUAL_STRING("", reader_line(&r, &len));
+     TEST_ASSERT_EQUAL_STRING("  cd /tmp ", reader_line(&r, NULL));
+     TEST_ASSERT_EQUAL_STRING(long_line, reader_line(&r, &len));
+     TEST_ASSERT_EQUAL_size_t(long_len, len);
+     //No newline at the end of the input
+     TEST_ASSERT_EQUAL_STRING("last", reader_line(&r, NULL));
+     TEST_ASSERT_NULL(reader_line(&r, NULL));
+     TEST_ASSERT_NULL(reader_line(&r, NULL));
+
+     reader_destroy(&r);
+     fclose(f);
+     free(long_line);
+}
+
+void test_reader_commands(void)
+{
+     TEST_ASSERT_TRUE(parse_incomplete("echo 'a"));
+     TEST_ASSERT_TRUE(parse_incomplete("echo \"a\\\" b"));
+     TEST_ASSERT_TRUE(parse_incomplete("echo a \\"));
+     TEST_ASSERT_FALSE(parse_incomplete("echo a \\\\"));
+     TEST_ASSERT_FALSE(parse_incomplete("echo \"it's\" # don't"));
+     TEST_ASSERT_FALSE(parse_incomplete("echo a#'b c'"));
+
+     //A script's quotes and backslash-newlines span lines
+     FILE *f = tmpfile();
+     fprintf(f, "echo one \\\ntwo\necho 'a\nb' \"c\n\\\"d\"\n# it's\necho \\\\\necho 'open\n");
+     rewind(f);
+
+     struct line_reader r;
+     reader_init(&r, fileno(f));
+     size_t len;
+     TEST_ASSERT_EQUAL_STRING("echo one \\\ntwo", reader_command(&r, &len));
+     TEST_ASSERT_EQUAL_size_t(14, len);
+     TEST_ASSERT_EQUAL_STRING("echo 'a\nb' \"c\n\\\"d\"", reader_command(&r, NULL));
+     TEST_ASSERT_EQUAL_STRING("# it's", reader_command(&r, NULL));
+     TEST_ASSERT_EQUAL_STRING("echo \\\\", reader_command(&r, NULL));
+     //Input that ends inside a quote is left for the parser to report
+     TEST_ASSERT_EQUAL_STRING("echo 'open\n", reader_command(&r, NULL));
+     TEST_ASSERT_NULL(reader_command(&r, NULL));
+     reader_destroy(&r);
+     fclose(f);
+
+     struct shell sh = {0};
+     FILE *out = tmpfile();
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     dup2(fileno(out), STDOUT_FILENO);
+     int first = sh_run_line(&sh, "echo one \\\ntwo", false);
+     int second = sh_run_line(&sh, "echo 'a\nb' \"c\n\\\"d\"", false);
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+     sh_destroy(&sh);
+
+     char buf[64];
+     rewind(out);
+     len = fread(buf, 1, sizeof(buf) - 1, out);
+     buf[len] = '\0';
+     fclose(out);
+     TEST_ASSERT_EQUAL_INT(0, first);
+     TEST_ASSERT_EQUAL_INT(0, second);
+     TEST_ASSERT_EQUAL_STRING("one two\na\nb c\n\"d\n", buf);
+}
+
+void test_builtin_lookup(void)
+{
+     const char *names[] = {"exit", "cd", "pwd", "history", "jobs", "hash", "echo",
+                            "printf", "test", "[", "true", "false", ":", "maxjobs",
+                            "parallel", "stats", "trace", "bench"};
+     for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+     {
+          const struct builtin *b = builtin_find(names[i]);
+          TEST_ASSERT_NOT_NULL_MESSAGE(b, names[i]);
+          TEST_ASSERT_EQUAL_STRING(names[i], b->name);
+          TEST_ASSERT_TRUE(is_builtin(names[i]));
+     }
+
+     const char *others[] = {"", "ls", "c", "cdd", "exi", "exit2", "Jobs", "/bin/pwd",
+                             "a-command-name-well-past-any-builtin"};
+     for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++)
+     {
+          TEST_ASSERT_NULL_MESSAGE(builtin_find(others[i]), others[i]);
+     }
+
+     struct shell sh = {0};
+     char *argv[] = {"cd", "/nonexistent/test-lab", NULL};
+     TEST_ASSERT_TRUE(do_builtin(&sh, argv));
+     TEST_ASSERT_EQUAL_INT(1, sh.last_status);
+     argv[0] = "ls";
+     TEST_ASSERT_FALSE(do_builtin(&sh, argv));
+}
+
+static int run_test_builtin(const char *line)
+{
+     struct shell sh = {0};
+     struct arena a;
+     struct node *n;
+     arena_init(&a, 0);
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&a, line, &n));
+     int status = execute(&sh, n);
+     arena_destroy(&a);
+     sh_destroy(&sh);
+     return status;
+}
+
+void test_builtin_test_status(void)
+{
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin("test -d /"));
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin("test -f /"));
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin("test"));
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin("[ x ]"));
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin("[ '' ]"));
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin("[ -n -a ]"));
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin("[ ! = ! ]"));
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin("[ 3 -gt 2 -a ! '(' a = b ')' ]"));
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin("[ 1 -eq 2 -o x != x ]"));
+     TEST_ASSERT_EQUAL_INT(2, run_test_builtin("[ x -eq 1 ] 2> /dev/null"));
+     TEST_ASSERT_EQUAL_INT(2, run_test_builtin("[ x 2> /dev/null"));
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin("true"));
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin("false"));
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(":"));
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin("false || :"));
+}
+
+void test_builtin_echo_printf(void)
+{
+     char out[] = "/tmp/test-lab-printXXXXXX";
+     int fd = mkstemp(out);
+     TEST_ASSERT_TRUE(fd >= 0);
+     close(fd);
+     char line[256];
+
+     snprintf(line, sizeof(line),
+              "echo -n a b; echo -e '\\tc\\cgone'; echo -- -n; printf '%%s=%%03d\\n' x 5 y; "
+              "printf '%%b|%%5.1f|%%x' 'q\\n' 2.25 255 > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(line));
+     //Only the last printf went to the file, the rest to stdout
+     FILE *f = fopen(out, "r");
+     TEST_ASSERT_NOT_NULL(f);
+     size_t len = fread(line, 1, sizeof(line) - 1, f);
+     line[len] = '\0';
+     fclose(f);
+     TEST_ASSERT_EQUAL_STRING("q\n|  2.2|ff", line);
+
+     snprintf(line, sizeof(line), "printf '%%d' 12x > %s 2>&1", out);
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin(line));
+     unlink(out);
+}
+
+void test_builtin_parallel(void)
+{
+     char out[] = "/tmp/test-lab-parallelXXXXXX";
+     int fd = mkstemp(out);
+     TEST_ASSERT_TRUE(fd >= 0);
+     close(fd);
+     char line[256];
+
+     //Each task's stdout and stderr stay together; the status counts failures
+     snprintf(line, sizeof(line),
+              "parallel -j 2 sh -c 'echo a{}; sleep 0.{}; echo b{} >&2; exit {}' ::: 2 0 1 > %s 2>&1", out);
+     TEST_ASSERT_EQUAL_INT(2, run_test_builtin(line));
+     FILE *f = fopen(out, "r");
+     TEST_ASSERT_NOT_NULL(f);
+     size_t len = fread(line, 1, sizeof(line) - 1, f);
+     line[len] = '\0';
+     fclose(f);
+     TEST_ASSERT_EQUAL_INT(18, len);
+     TEST_ASSERT_NOT_NULL(strstr(line, "a0\nb0\n"));
+     TEST_ASSERT_NOT_NULL(strstr(line, "a1\nb1\n"));
+     TEST_ASSERT_NOT_NULL(strstr(line, "a2\nb2\n"));
+
+     //Items from stdin, with parallel itself in a forked pipeline stage
+     snprintf(line, sizeof(line), "printf '1\\n2\\n3\\n' | parallel -j 2 echo n{}x > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(line));
+     f = fopen(out, "r");
+     TEST_ASSERT_NOT_NULL(f);
+     len = fread(line, 1, sizeof(line) - 1, f);
+     line[len] = '\0';
+     fclose(f);
+     TEST_ASSERT_EQUAL_INT(12, len);
+     TEST_ASSERT_NOT_NULL(strstr(line, "n1x\n"));
+     TEST_ASSERT_NOT_NULL(strstr(line, "n2x\n"));
+     TEST_ASSERT_NOT_NULL(strstr(line, "n3x\n"));
+
+     //The first worker's deque holds the long task and three short ones;
+     //the idle worker steals those, so the long task is the last to print
+     snprintf(line, sizeof(line),
+              "parallel -j 2 sh -c 'sleep {}; echo {}' ::: 1.2 0.1 0.1 0.1 0.1 0.1 0.1 > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(line));
+     f = fopen(out, "r");
+     TEST_ASSERT_NOT_NULL(f);
+     len = fread(line, 1, sizeof(line) - 1, f);
+     line[len] = '\0';
+     fclose(f);
+     TEST_ASSERT_EQUAL_STRING("0.1\n0.1\n0.1\n0.1\n0.1\n0.1\n1.2\n", line);
+
+     TEST_ASSERT_EQUAL_INT(255, run_test_builtin("parallel -j x echo 2> /dev/null"));
+     unlink(out);
+}
+
+#ifdef __SANITIZE_ADDRESS__
+static volatile long mallocs = -1; //counted only while not negative
+
+//Called by the ASan allocator for every malloc, calloc and realloc
+void __sanitizer_malloc_hook(const volatile void *ptr, size_t size)
+{
+     (void)ptr;
+     (void)size;
+     if (mallocs >= 0)
+     {
+          mallocs++;
+     }
+}
+#endif
+
+void test_command_arena_mallocs(void)
+{
+#ifndef __SANITIZE_ADDRESS__
+     TEST_IGNORE_MESSAGE("needs the ASan malloc hook");
+#else
+     struct shell sh = {0};
+     const char *lines[] = {"true && false || :", "/bin/true", "echo hi > /dev/null",
+                            "test 1 -eq 1 && printf '%s %d\\n' x 1 > /dev/null",
+                            "[ -d / ] || cd /nonexistent"};
+     size_t n = sizeof(lines) / sizeof(lines[0]);
+
+     //The first round fills the arena and the PATH cache
+     for (size_t i = 0; i < n; i++)
+     {
+          sh_run_line(&sh, lines[i], false);
+     }
+     mallocs = 0;
+     for (int round = 0; round < 100; round++)
+     {
+          for (size_t i = 0; i < n; i++)
+          {
+               sh_run_line(&sh, lines[i], false);
+          }
+     }
+     long counted = mallocs;
+     mallocs = -1;
+     TEST_ASSERT_EQUAL_INT(0, counted);
+     TEST_ASSERT_EQUAL_INT(0, sh.last_status);
+     sh_destroy(&sh);
+#endif
+}
+
+void test_stats_histogram(void)
+{
+     //Percentiles are the top of their bucket, within 1/16 of the sample
+     struct stats st = {0};
+     struct stats_hist *h = &st.stage[STAT_PARSE];
+     TEST_ASSERT_EQUAL_UINT64(0, stats_percentile(h, 50));
+     for (uint64_t ns = 1; ns <= 100000; ns++)
+     {
+          stats_add(h, ns);
+     }
+     TEST_ASSERT_EQUAL_UINT64(100000, h->count);
+     TEST_ASSERT_EQUAL_UINT64(1, stats_percentile(h, 0));
+     uint64_t p50 = stats_percentile(h, 50);
+     uint64_t p99 = stats_percentile(h, 99);
+     TEST_ASSERT_TRUE(p50 >= 50000 && p50 <= 50000 + 50000 / 16);
+     TEST_ASSERT_TRUE(p99 >= 99000 && p99 <= 100000);
+     TEST_ASSERT_EQUAL_UINT64(100000, stats_percentile(h, 100));
+     //Past the last bucket only the max stays exact
+     stats_add(h, (uint64_t)1 << 50);
+     TEST_ASSERT_EQUAL_UINT64((uint64_t)1 << 50, h->max);
+     TEST_ASSERT_EQUAL_UINT64((uint64_t)1 << 50, stats_percentile(h, 100));
+
+     //Every line a shell runs is timed stage by stage
+     struct shell sh = {0};
+     sh_run_line(&sh, "true", false);
+     sh_run_line(&sh, "/bin/true | /bin/true", false);
+     TEST_ASSERT_EQUAL_UINT64(2, sh.stats.stage[STAT_PARSE].count);
+     TEST_ASSERT_EQUAL_UINT64(1, sh.stats.stage[STAT_BUILTIN].count);
+     TEST_ASSERT_EQUAL_UINT64(2, sh.stats.stage[STAT_PATH].count);
+     TEST_ASSERT_EQUAL_UINT64(2, sh.stats.stage[STAT_EXEC].count);
+     TEST_ASSERT_EQUAL_UINT64(1, sh.stats.stage[STAT_WAIT].count);
+     TEST_ASSERT_TRUE(sh.stats.stage[STAT_WAIT].max > 0);
+
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     FILE *out = tmpfile();
+     dup2(fileno(out), STDOUT_FILENO);
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "stats", false));
+     TEST_ASSERT_EQUAL_INT(2, sh_run_line(&sh, "stats -x 2> /dev/null", false));
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "stats -r", false));
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+     char buf[1024];
+     rewind(out);
+     size_t len = fread(buf, 1, sizeof(buf) - 1, out);
+     buf[len] = '\0';
+     fclose(out);
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\nexec              2 "));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\nfork              0          -"));
+     //Only the reset itself is left
+     TEST_ASSERT_EQUAL_UINT64(0, sh.stats.stage[STAT_PARSE].count);
+     TEST_ASSERT_EQUAL_UINT64(1, sh.stats.stage[STAT_BUILTIN].count);
+     sh_destroy(&sh);
+}
+
+void test_trace_timeline(void)
+{
+     struct shell sh = {0};
+     char path[] = "/tmp/test-lab-traceXXXXXX";
+     close(mkstemp(path));
+
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     int null = open("/dev/null", O_WRONLY);
+     dup2(null, STDOUT_FILENO);
+     close(null);
+
+     char start[64];
+     snprintf(start, sizeof(start), "trace start %s", path);
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, start, false));
+     TEST_ASSERT_EQUAL_STRING(path, trace_file());
+     TEST_ASSERT_EQUAL_INT(1, sh_run_line(&sh, "trace start /tmp/other 2> /dev/null", false));
+     sh_run_line(&sh, "echo \"quoted\\\\\" > /dev/null", false);
+     sh_run_line(&sh, "/bin/true | /bin/true", false);
+     sh_run_line(&sh, "/bin/true &", false);
+     //The job's lifetime ends when it is reaped
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     while (check_jobs() == 0)
+     {
+          while (poll(&p, 1, 5000) < 0 && errno == EINTR)
+               ;
+     }
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "trace stop", false));
+     TEST_ASSERT_NULL(trace_file());
+     TEST_ASSERT_EQUAL_INT(1, sh_run_line(&sh, "trace stop 2> /dev/null", false));
+     TEST_ASSERT_EQUAL_INT(2, sh_run_line(&sh, "trace 2> /dev/null", false));
+
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+     sh_destroy(&sh);
+
+     FILE *f = fopen(path, "r");
+     char buf[16384];
+     size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+     buf[len] = '\0';
+     fclose(f);
+     unlink(path);
+     TEST_ASSERT_EQUAL_INT(0, strncmp(buf, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 37));
+     TEST_ASSERT_EQUAL_STRING("\n]}\n", buf + len - 4);
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\"name\":\"parse\""));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\"args\":{\"cmd\":\"echo \\\"quoted\\\\\\\\\\\" > /dev/null\"}"));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\"name\":\"wait\""));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\"name\":\"exec\""));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\"ph\":\"b\""));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\"ph\":\"e\""));
+     int depth = 0;
+     for (size_t i = 0; i < len; i++)
+     {
+          depth += (buf[i] == '{' || buf[i] == '[') - (buf[i] == '}' || buf[i] == ']');
+          TEST_ASSERT_TRUE(depth >= 0);
+     }
+     TEST_ASSERT_EQUAL_INT(0, depth);
+}
+
+void test_trace_survives_last_command(void)
+{
+     char path[] = "/tmp/test-lab-traceXXXXXX";
+     close(mkstemp(path));
+
+     //What -c does with its last command, in a child in case it execs
+     fflush(stdout);
+     pid_t pid = fork();
+     if (pid == 0)
+     {
+          struct shell sh = {0};
+          char line[96];
+          snprintf(line, sizeof(line), "trace start %s; /bin/true", path);
+          sh_run_line(&sh, line, true);
+          sh_destroy(&sh);
+          _exit(sh.last_status);
+     }
+     int status;
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+     TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+
+     FILE *f = fopen(path, "r");
+     char buf[16384];
+     size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+     buf[len] = '\0';
+     fclose(f);
+     unlink(path);
+     TEST_ASSERT_TRUE(len > 4);
+     TEST_ASSERT_EQUAL_INT(0, strncmp(buf, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 37));
+     TEST_ASSERT_EQUAL_STRING("\n]}\n", buf + len - 4);
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\"name\":\"exec\""));
+     int depth = 0;
+     for (size_t i = 0; i < len; i++)
+     {
+          depth += (buf[i] == '{' || buf[i] == '[') - (buf[i] == '}' || buf[i] == ']');
+          TEST_ASSERT_TRUE(depth >= 0);
+     }
+     TEST_ASSERT_EQUAL_INT(0, depth);
+}
+
+void test_time_keyword(void)
+{
+     struct shell sh = {0};
+     struct node *n;
+
+     //time covers the whole pipeline and prints back as it was written
+     TEST_ASSERT_EQUAL_INT(0, parse_line(&sh.mem, "time ls / | wc -l && time", &n));
+     TEST_ASSERT_EQUAL_INT(NODE_AND, n->type);
+     TEST_ASSERT_EQUAL_INT(NODE_TIME, n->pair.left->type);
+     TEST_ASSERT_EQUAL_INT(NODE_PIPELINE, n->pair.left->child->type);
+     TEST_ASSERT_EQUAL_INT(NODE_TIME, n->pair.right->type);
+     TEST_ASSERT_NULL(n->pair.right->child);
+     char text[64];
+     node_format(n, text, sizeof(text));
+     TEST_ASSERT_EQUAL_STRING("time ls / | wc -l && time", text);
+     arena_reset(&sh.mem);
+
+     fflush(stdout);
+     fflush(stderr);
+     int saved_out = dup(STDOUT_FILENO);
+     int saved_err = dup(STDERR_FILENO);
+     int null = open("/dev/null", O_WRONLY);
+     dup2(null, STDOUT_FILENO);
+     close(null);
+     FILE *err = tmpfile();
+     dup2(fileno(err), STDERR_FILENO);
+
+     //The status is the pipeline's and the shell does the waiting itself
+     TEST_ASSERT_EQUAL_INT(3, sh_run_line(&sh, "time /bin/sh -c 'exit 3'", false));
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "time true | /bin/sh -c 'i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done'", false));
+     TEST_ASSERT_NULL(sh.usage);
+
+     //A finished job keeps what it used for jobs -l
+     sh_run_line(&sh, "/bin/sh -c 'exit 4' &", false);
+     struct pollfd p = {.fd = jobs_event_fd(), .events = POLLIN};
+     while (check_jobs() == 0)
+     {
+          while (poll(&p, 1, 5000) < 0 && errno == EINTR)
+               ;
+     }
+     FILE *out = tmpfile();
+     dup2(fileno(out), STDOUT_FILENO);
+     sh_run_line(&sh, "jobs -l", false);
+
+     fflush(stdout);
+     fflush(stderr);
+     dup2(saved_out, STDOUT_FILENO);
+     dup2(saved_err, STDERR_FILENO);
+     close(saved_out);
+     close(saved_err);
+     sh_destroy(&sh);
+
+     char buf[2048];
+     rewind(err);
+     size_t len = fread(buf, 1, sizeof(buf) - 1, err);
+     buf[len] = '\0';
+     fclose(err);
+     TEST_ASSERT_EQUAL_INT(0, strncmp(buf, "real\t0m0.", 9));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\nuser\t0m"));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\nsys\t0m"));
+     TEST_ASSERT_NOT_NULL(strstr(buf, " KB\nctxsw\t"));
+     TEST_ASSERT_NOT_NULL(strstr(buf, " major\nreal\t"));
+     //The busy loop took some CPU time, which a fork of our own would hide
+     const char *second = strstr(buf, " major\nreal\t") + 7;
+     long user_ms = 0, sys_ms = 0;
+     const char *u = strstr(second, "user\t0m");
+     const char *sy = strstr(second, "sys\t0m");
+     user_ms = strtol(u + 8, NULL, 10) * 1000 + strtol(strchr(u, '.') + 1, NULL, 10);
+     sys_ms = strtol(sy + 7, NULL, 10) * 1000 + strtol(strchr(sy, '.') + 1, NULL, 10);
+     TEST_ASSERT_TRUE(user_ms + sys_ms > 0);
+
+     rewind(out);
+     len = fread(buf, 1, sizeof(buf) - 1, out);
+     buf[len] = '\0';
+     fclose(out);
+     TEST_ASSERT_NOT_NULL(strstr(buf, " Done /bin/sh -c 'exit 4' &\n    status 4 real "));
+     TEST_ASSERT_NOT_NULL(strstr(buf, " KB ctxsw "));
+}
+
+void test_jobs_end_time(void)
+{
+     struct shell sh = {0};
+
+     fflush(stdout);
+     int saved = dup(STDOUT_FILENO);
+     FILE *out = tmpfile();
+     dup2(fileno(out), STDOUT_FILENO);
+
+     //The job ends while the shell waits for the foreground, and is timed
+     //to its exit, not to the next prompt
+     sh_run_line(&sh, "sleep 0.05 &", false);
+     int status = sh_run_line(&sh, "sleep 0.5", false);
+     bool live = jobs_live();
+     sh_run_line(&sh, "jobs -l", false);
+
+     fflush(stdout);
+     dup2(saved, STDOUT_FILENO);
+     close(saved);
+     sh_destroy(&sh);
+     TEST_ASSERT_EQUAL_INT(0, status);
+     TEST_ASSERT_FALSE(live);
+
+     char buf[2048];
+     rewind(out);
+     size_t len = fread(buf, 1, sizeof(buf) - 1, out);
+     buf[len] = '\0';
+     fclose(out);
+     const char *real = strstr(buf, " Done sleep 0.05 &\n    status 0 real ");
+     TEST_ASSERT_NOT_NULL(real);
+     TEST_ASSERT_TRUE(strtod(strstr(real, "real ") + 5, NULL) < 0.4);
+}
+
+void test_run_string(void)
+{
+     char path[] = "/tmp/test-lab-stringXXXXXX";
+     close(mkstemp(path));
+
+     //The -c string is parsed whole; in a child in case its last command execs
+     fflush(stdout);
+     pid_t pid = fork();
+     if (pid == 0)
+     {
+          struct shell sh = {0};
+          char s[160];
+          snprintf(s, sizeof(s), "\n echo \"a\nb\" > %s\n\necho one \\\n two >> %s\n", path, path);
+          sh_run_string(&sh, s);
+          sh_destroy(&sh);
+          _exit(sh.last_status);
+     }
+     int status;
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+     TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+
+     FILE *f = fopen(path, "r");
+     char buf[64];
+     size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+     buf[len] = '\0';
+     fclose(f);
+     TEST_ASSERT_EQUAL_STRING("a\nb\none two\n", buf);
+
+     //A syntax error anywhere runs none of the string
+     truncate(path, 0);
+     struct shell sh = {0};
+     char s[96];
+     snprintf(s, sizeof(s), "echo ran > %s\necho 'open", path);
+     TEST_ASSERT_EQUAL_INT(2, sh_run_string(&sh, s));
+     sh_destroy(&sh);
+     f = fopen(path, "r");
+     len = fread(buf, 1, sizeof(buf) - 1, f);
+     fclose(f);
+     unlink(path);
+     TEST_ASSERT_EQUAL_size_t(0, len);
+}
+
+void test_parse_args_modes(void)
+{
+     struct shell sh = {0};
+     char *c_argv[] = {"myprogram", "-c", "pwd; true", NULL};
+     optind = 0;
+     parse_args(&sh, 3, c_argv);
+     TEST_ASSERT_EQUAL_STRING("pwd; true", sh.command);
+     TEST_ASSERT_NULL(sh.script);
+
+     //-c and scripts never touch the terminal or build a prompt
+     sh_init(&sh);
+     TEST_ASSERT_FALSE(sh.shell_is_interactive);
+     TEST_ASSERT_NULL(sh.prompt);
+     sh_destroy(&sh);
+
+     struct shell script = {0};
+     char *s_argv[] = {"myprogram", "run.sh", "-x", "arg", NULL};
+     optind = 0;
+     parse_args(&script, 4, s_argv);
+     TEST_ASSERT_NULL(script.command);
+     TEST_ASSERT_EQUAL_STRING("run.sh", script.script);
+}
+
+void test_builtin_bench(void)
+{
+     struct shell sh = {0};
+
+     fflush(stdout);
+     fflush(stderr);
+     int saved_out = dup(STDOUT_FILENO);
+     int saved_err = dup(STDERR_FILENO);
+     int null = open("/dev/null", O_WRONLY);
+     dup2(null, STDERR_FILENO);
+     close(null);
+     FILE *out = tmpfile();
+     dup2(fileno(out), STDOUT_FILENO);
+
+     //Words are one command, a single argument is a whole line
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "bench -n 20 -w 2 /bin/echo hidden", false));
+     TEST_ASSERT_EQUAL_INT(0, sh_run_line(&sh, "bench -n5 -w0 'echo hidden | cat'", false));
+     //The first failed run stops it with its status
+     TEST_ASSERT_EQUAL_INT(3, sh_run_line(&sh, "bench -n 5 /bin/sh -c 'exit 3'", false));
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+     TEST_ASSERT_NULL(sh.usage);
+     TEST_ASSERT_EQUAL_INT(2, sh_run_line(&sh, "bench -n x true", false));
+     TEST_ASSERT_EQUAL_INT(2, sh_run_line(&sh, "bench -n 0 true", false));
+     TEST_ASSERT_EQUAL_INT(2, sh_run_line(&sh, "bench -w", false));
+     TEST_ASSERT_EQUAL_INT(2, sh_run_line(&sh, "bench", false));
+     TEST_ASSERT_EQUAL_INT(2, sh_run_line(&sh, "bench 'echo |'", false));
+
+     fflush(stdout);
+     dup2(saved_out, STDOUT_FILENO);
+     dup2(saved_err, STDERR_FILENO);
+     close(saved_out);
+     close(saved_err);
+     sh_destroy(&sh);
+
+     char buf[2048];
+     rewind(out);
+     size_t len = fread(buf, 1, sizeof(buf) - 1, out);
+     buf[len] = '\0';
+     fclose(out);
+     //Only the two reports, none of the command's own output
+     TEST_ASSERT_NULL(strstr(buf, "hidden\n"));
+     TEST_ASSERT_EQUAL_INT(0, strncmp(buf, "bench: /bin/echo, 20 runs after 2 warmup\n", 41));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "bench: echo hidden | cat, 5 runs after 0 warmup\n"));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\n  mean     "));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\n  p99      "));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\n  outliers "));
+     TEST_ASSERT_NOT_NULL(strstr(buf, "\n  ctxsw    "));
+}
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_cmd_parse);
   RUN_TEST(test_cmd_parse2);
+  RUN_TEST(test_cmd_parse_packed);
+  RUN_TEST(test_cmd_parse_only_delims);
   RUN_TEST(test_trim_white_no_whitespace);
   RUN_TEST(test_trim_white_start_whitespace);
   RUN_TEST(test_trim_white_end_whitespace);
   RUN_TEST(test_trim_white_both_whitespace_single);
   RUN_TEST(test_trim_white_both_whitespace_double);
   RUN_TEST(test_trim_white_all_whitespace);
+  RUN_TEST(test_trim_white_mostly_whitespace);
+  RUN_TEST(test_scan_matches_reference);
+  RUN_TEST(test_scan_long_runs);
   RUN_TEST(test_get_prompt_default);
   RUN_TEST(test_get_prompt_custom);
   RUN_TEST(test_ch_dir_home);
   RUN_TEST(test_ch_dir_root);
+  RUN_TEST(test_parse_quotes_and_escapes);
+  RUN_TEST(test_parse_lists);
+  RUN_TEST(test_parse_pipeline_and_redirects);
+  RUN_TEST(test_parse_errors_and_blank);
+  RUN_TEST(test_arena_reset_reuses_chunks);
+  RUN_TEST(test_arena_alignment);
+  RUN_TEST(test_spawn_process);
+  RUN_TEST(test_execute_status);
+  RUN_TEST(test_pipeline_status_and_data);
+  RUN_TEST(test_redirections_spawned);
+  RUN_TEST(test_zygote_spawn);
+  RUN_TEST(test_path_cache);
+  RUN_TEST(test_path_cache_heals);
+  RUN_TEST(test_jobs_reaped_on_sigchld);
+  RUN_TEST(test_jobs_stress);
+  RUN_TEST(test_jobs_out_of_descriptors);
+  RUN_TEST(test_jobs_reuse_ids);
+  RUN_TEST(test_pipeline_job_stages);
+  RUN_TEST(test_jobs_maxjobs_queue);
+  RUN_TEST(test_jobs_full_command);
+  RUN_TEST(test_reader_lines);
+  RUN_TEST(test_reader_commands);
+  RUN_TEST(test_run_string);
+  RUN_TEST(test_parse_args_modes);
+  RUN_TEST(test_builtin_lookup);
+  RUN_TEST(test_builtin_test_status);
+  RUN_TEST(test_builtin_echo_printf);
+  RUN_TEST(test_builtin_parallel);
+  RUN_TEST(test_command_arena_mallocs);
+  RUN_TEST(test_stats_histogram);
+  RUN_TEST(test_trace_timeline);
+  RUN_TEST(test_trace_survives_last_command);
+  RUN_TEST(test_time_keyword);
+  RUN_TEST(test_jobs_end_time);
+  RUN_TEST(test_builtin_bench);
 
   return UNITY_END();
 }